@@ -13,15 +13,46 @@
     #define CACHE_SIZE_KB 100  // Уменьшено со 160 до 100KB для Pico 1
 #endif
 
+// Cache Replacement Policy
+// CACHE_POLICY_LRU - чистый LRU (вымывается одним большим последовательным чтением)
+// CACHE_POLICY_2Q  - устойчивый к сканированию 2Q (A1in FIFO + призрачный A1out + Am LRU)
+#define CACHE_POLICY_LRU    0
+#define CACHE_POLICY_2Q     1
+#define CACHE_POLICY        CACHE_POLICY_2Q
+
+// Resident Mode
+// Образ, целиком помещающийся в кеш (160K-320K на Pico 2), читается в RAM при
+// загрузке; чтение/запись хоста не обращаются к SD, изменения пишутся при простое/извлечении
+#define CACHE_RESIDENT_MODE 1
+
 // Pin Configuration (GPIO0-GPIO15 для совместимости с nano RP2040/RP2350)
 // GPIO0, GPIO1 зарезервированы для UART (отладка)
 
+// Шина SD-карты
+// SD_BACKEND_SPI  - SPI mode, 1 бит данных (пины SD_PIN_*)
+// SD_BACKEND_SDIO - нативная шина SD через PIO, 4 бита данных, 25 МГц (пины SD_SDIO_PIN_*)
+#define SD_BACKEND_SPI      0
+#define SD_BACKEND_SDIO     1
+#define SD_BACKEND          SD_BACKEND_SPI
+
 // SPI for SD Card
 #define SD_SPI_PORT     spi0
 #define SD_PIN_MISO     4    // Было 16, теперь 4
 #define SD_PIN_CS       5    // Было 17, теперь 5
 #define SD_PIN_SCK      6    // Было 18, теперь 6
 #define SD_PIN_MOSI     7    // Было 19, теперь 7
+#define SD_SPI_MAX_HZ   50000000  // Верхняя граница подбора частоты SPI (длинные провода - снизить)
+#define SD_CRC_CHECK    1    // Проверка CRC16 данных (CMD59), сбойные блоки перечитываются
+
+// SDIO for SD Card (DAT0-DAT3 должны идти подряд)
+#define SD_SDIO_PIN_D0      4    // DAT0-DAT3 = GPIO4-7 (вместо SPI)
+#define SD_SDIO_PIN_CLK     8
+#define SD_SDIO_PIN_CMD     9
+
+// Обнаружение извлечения SD-карты
+#define SD_PIN_CD           -1   // Вывод Card Detect слота (-1 = не подключен, опрос CMD13)
+#define SD_CD_ACTIVE_LOW    1    // Карта вставлена = низкий уровень (контакт на GND)
+#define SD_PRESENCE_POLL_MS 250  // Период проверки наличия карты при простое
 
 // I2C for OLED Display
 #define OLED_I2C_PORT   i2c1  // GPIO2,3 принадлежат I2C1, а не I2C0!
@@ -62,7 +93,7 @@
 #define FLOPPY_IMAGE_SIZE       (FLOPPY_TOTAL_SECTORS * FLOPPY_SECTOR_SIZE)  // 1.44MB
 
 // SD Card Configuration
-#define MAX_IMAGES      32
+#define IMAGE_PATH_MAX  128     // Полный путь к образу или каталогу на карте (с '\0')
 #define IMAGE_EXTENSION ".img"
 
 // Display Configuration
@@ -82,11 +113,13 @@
 #define TASK_PRIORITY_UI        2       // Средний приоритет - OLED и MENU
 #define TASK_PRIORITY_STORAGE   2       // Средний приоритет - SD карта
 #define TASK_PRIORITY_LED       1       // Низкий приоритет - LED индикация
+#define TASK_PRIORITY_CONSOLE   1       // Низкий приоритет - отладочная консоль UART
 
 #define STACK_SIZE_CONTROL      256     // Управление - небольшой стек
 #define STACK_SIZE_USB          1024    // USB - большой стек для TinyUSB
 #define STACK_SIZE_UI           512     // UI задачи
 #define STACK_SIZE_STORAGE      1024    // Работа с файлами
 #define STACK_SIZE_LED          256     // LED - минимальный стек
+#define STACK_SIZE_CONSOLE      512     // Консоль - разбор команд и printf
 
 #endif // CONFIG_H
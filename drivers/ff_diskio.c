@@ -80,14 +80,10 @@ DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
         return RES_NOTRDY;
     }
     
-    if (count == 1) {
-        if (sd_card_write_block(sector, buff)) {
-            return RES_OK;
-        }
-    } else {
-        if (sd_card_write_blocks(sector, count, buff)) {
-            return RES_OK;
-        }
+    // Consecutive writes continue one multi-block write; CTRL_SYNC
+    // or the next read closes it
+    if (sd_card_write_stream(sector, count, buff)) {
+        return RES_OK;
     }
     
     return RES_ERROR;
@@ -110,8 +106,8 @@ DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
     
     switch (cmd) {
         case CTRL_SYNC:
-            // No cache, always synced
-            return RES_OK;
+            // Finish the open multi-block write and check the card status
+            return sd_card_sync() ? RES_OK : RES_ERROR;
             
         case GET_SECTOR_COUNT:
             *(LBA_t*)buff = info->sectors;
@@ -3,8 +3,18 @@
  * @brief Low-level SD Card driver implementation
  */
 
+#include "config.h"
+
+#if SD_BACKEND == SD_BACKEND_SPI
+
 #include "sd_card.h"
+#include "sd_proto.h"
 #include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+#include "FreeRTOS.h"
+#include "task.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -15,14 +25,16 @@
 #define CMD9    9       // SEND_CSD
 #define CMD10   10      // SEND_CID
 #define CMD12   12      // STOP_TRANSMISSION
+#define CMD13   13      // SEND_STATUS
 #define CMD16   16      // SET_BLOCKLEN
 #define CMD17   17      // READ_SINGLE_BLOCK
 #define CMD18   18      // READ_MULTIPLE_BLOCK
-#define CMD23   23      // SET_BLOCK_COUNT
+#define CMD23   23      // SET_BLOCK_COUNT (ACMD23 = SET_WR_BLK_ERASE_COUNT)
 #define CMD24   24      // WRITE_BLOCK
 #define CMD25   25      // WRITE_MULTIPLE_BLOCK
 #define CMD55   55      // APP_CMD
 #define CMD58   58      // READ_OCR
+#define CMD59   59      // CRC_ON_OFF
 #define ACMD41  41      // SD_SEND_OP_COND (must be preceded by CMD55)
 
 // SD Card responses
@@ -34,11 +46,57 @@
 #define TOKEN_START_MULTI       0xFC
 #define TOKEN_STOP_MULTI        0xFD
 
+// Data response token (low 5 bits)
+#define DATA_RESP_ACCEPTED      0x05
+#define DATA_RESP_CRC_ERROR     0x0B
+
+#define SD_READ_RETRIES         3       // Extra attempts for a block that failed to read
+
+// Card polling: spin briefly, then poll once per tick and let other tasks run
+#define SD_WAIT_SPIN_US         50      // Covers the common short waits
+#define SD_BUSY_TIMEOUT_MS      500     // Write/erase busy limit
+#define SD_READ_TIMEOUT_MS      200     // Read access time limit
+
+// Power-up (ACMD41) polling
+#define SD_INIT_POLL_MS         1       // Most cards finish within a few ms of a poll
+#define SD_INIT_TIMEOUT_MS      1000    // Spec limit for ACMD41 initialization
+
 // SPI settings
+#define SD_SPI_INIT_HZ          (400 * 1000)
+#define SD_SPI_SAFE_HZ          (12500 * 1000)  // Works with any card and short wiring
+#define SD_SPI_PROBE_READS      8               // CRC-checked reads per candidate clock
+
 static spi_inst_t *spi_instance = NULL;
 static uint cs_pin = 0;
 static sd_card_info_t card_info = {0};
 
+// Last card that completed init: a reinserted card with the same CID
+// reuses its negotiated clock instead of probing again
+static uint8_t known_cid[16];
+static uint32_t known_clock_hz = 0;
+
+// Open-ended multi-block write (CMD25 kept open between calls, CS held low)
+static bool stream_active = false;
+static uint32_t stream_next_block = 0;
+
+// Open-ended multi-block read (CMD18 kept open while requests stay contiguous)
+static bool read_stream_active = false;
+static uint32_t read_stream_next_block = 0;
+
+// Data accepted since the last sd_card_sync(), status not checked yet
+static bool write_unsynced = false;
+
+// DMA block transfers
+#define SD_DMA_NOTIFY_INDEX     1       // Task notification slot used for DMA completion
+#define SD_DMA_TIMEOUT_MS       100     // 512 bytes take ~330 us at 12.5 MHz
+
+static int dma_tx_chan = -1;
+static int dma_rx_chan = -1;
+static volatile int dma_done_chan = -1;             // Channel whose completion ends the transfer
+static TaskHandle_t volatile dma_waiter = NULL;     // Task blocked on the transfer
+static const uint8_t dma_fill_byte = 0xFF;          // Clocked out while reading
+static uint8_t dma_drain_byte;
+
 /**
  * @brief Chip select control
  */
@@ -63,17 +121,206 @@ static inline uint8_t spi_transfer(uint8_t data) {
 }
 
 /**
- * @brief Wait for SD card ready
+ * @brief DMA completion interrupt: wake the task waiting for the transfer
  */
-static bool sd_wait_ready(uint32_t timeout_ms) {
-    absolute_time_t timeout = make_timeout_time_ms(timeout_ms);
+static void sd_dma_irq_handler(void) {
+    int chan = dma_done_chan;
+    if (chan < 0 || !dma_channel_get_irq0_status(chan)) {
+        return;  // Shared IRQ raised by another channel
+    }
+    dma_channel_acknowledge_irq0(chan);
     
-    while (spi_transfer(0xFF) != 0xFF) {
-        if (time_reached(timeout)) {
-            return false;
+    BaseType_t woken = pdFALSE;
+    if (dma_waiter != NULL) {
+        vTaskNotifyGiveIndexedFromISR(dma_waiter, SD_DMA_NOTIFY_INDEX, &woken);
+    }
+    portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * @brief Claim DMA channels and install the completion handler (once)
+ */
+static void sd_dma_init(void) {
+    if (dma_tx_chan >= 0) {
+        return;
+    }
+    
+    dma_tx_chan = dma_claim_unused_channel(true);
+    dma_rx_chan = dma_claim_unused_channel(true);
+    
+    irq_add_shared_handler(DMA_IRQ_0, sd_dma_irq_handler,
+                           PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
+
+/**
+ * @brief Move a data block over SPI with DMA
+ * @param tx Bytes to send, or NULL to clock out 0xFF (read)
+ * @param rx Buffer for received bytes, or NULL to discard them (write)
+ * @param length Number of bytes
+ * @param crc If not NULL, receives the CRC16 of the data block
+ * @return true when the transfer completed in time
+ * 
+ * The calling task sleeps on a notification while the transfer runs, so
+ * other tasks get the CPU. Before the scheduler starts the driver busy-waits.
+ * The CRC is computed by the DMA sniffer on the channel carrying the
+ * block data, so checking it costs no CPU time.
+ */
+static bool sd_dma_transfer(const uint8_t *tx, uint8_t *rx, uint32_t length, uint16_t *crc) {
+    spi_hw_t *hw = spi_get_hw(spi_instance);
+    
+    // Reads complete on the RX channel; writes on TX, then the RX FIFO is drained
+    int done_chan = (rx != NULL) ? dma_rx_chan : dma_tx_chan;
+    bool use_notify = (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+    
+    dma_channel_config tx_cfg = dma_channel_get_default_config(dma_tx_chan);
+    channel_config_set_transfer_data_size(&tx_cfg, DMA_SIZE_8);
+    channel_config_set_read_increment(&tx_cfg, tx != NULL);
+    channel_config_set_write_increment(&tx_cfg, false);
+    channel_config_set_dreq(&tx_cfg, spi_get_dreq(spi_instance, true));
+    channel_config_set_sniff_enable(&tx_cfg, crc != NULL && rx == NULL);
+    dma_channel_configure(dma_tx_chan, &tx_cfg, &hw->dr,
+                          (tx != NULL) ? tx : &dma_fill_byte, length, false);
+    
+    uint32_t start_mask = 1u << dma_tx_chan;
+    if (rx != NULL) {
+        dma_channel_config rx_cfg = dma_channel_get_default_config(dma_rx_chan);
+        channel_config_set_transfer_data_size(&rx_cfg, DMA_SIZE_8);
+        channel_config_set_read_increment(&rx_cfg, false);
+        channel_config_set_write_increment(&rx_cfg, true);
+        channel_config_set_dreq(&rx_cfg, spi_get_dreq(spi_instance, false));
+        channel_config_set_sniff_enable(&rx_cfg, crc != NULL);
+        dma_channel_configure(dma_rx_chan, &rx_cfg, rx, &hw->dr, length, false);
+        start_mask |= 1u << dma_rx_chan;
+    }
+    
+    // Status left by an earlier aborted transfer would complete this one at once
+    dma_channel_acknowledge_irq0(done_chan);
+    dma_channel_set_irq0_enabled(dma_tx_chan, use_notify && done_chan == dma_tx_chan);
+    dma_channel_set_irq0_enabled(dma_rx_chan, use_notify && done_chan == dma_rx_chan);
+    
+    if (use_notify) {
+        dma_waiter = xTaskGetCurrentTaskHandle();
+        dma_done_chan = done_chan;
+        // A late IRQ of a timed-out transfer leaves the count at 1: clear the value, not just the state
+        ulTaskNotifyValueClearIndexed(NULL, SD_DMA_NOTIFY_INDEX, UINT32_MAX);
+        xTaskNotifyStateClearIndexed(NULL, SD_DMA_NOTIFY_INDEX);
+    }
+    
+    if (crc != NULL) {
+        // CRC-16-CCITT with zero seed, MSB first: the SD data CRC
+        dma_sniffer_enable((rx != NULL) ? dma_rx_chan : dma_tx_chan,
+                           DMA_SNIFF_CTRL_CALC_VALUE_CRC16, true);
+        dma_sniffer_set_data_accumulator(0);
+    }
+    
+    // Both channels start together so the RX FIFO never overflows on reads
+    dma_start_channel_mask(start_mask);
+    
+    bool success = true;
+    if (use_notify) {
+        if (ulTaskNotifyTakeIndexed(SD_DMA_NOTIFY_INDEX, pdTRUE, pdMS_TO_TICKS(SD_DMA_TIMEOUT_MS)) == 0) {
+            // IRQ off before the abort (an aborted channel may still raise it), then acknowledge
+            dma_channel_set_irq0_enabled(done_chan, false);
+            dma_channel_abort(dma_tx_chan);
+            dma_channel_abort(dma_rx_chan);
+            dma_channel_acknowledge_irq0(done_chan);
+            printf("[SD] DMA transfer timeout\n");
+            success = false;
         }
+        dma_done_chan = -1;
+        dma_waiter = NULL;
+        dma_channel_set_irq0_enabled(done_chan, false);
+    } else {
+        dma_channel_wait_for_finish_blocking(done_chan);
     }
-    return true;
+    
+    if (rx == NULL) {
+        // TX-only: wait for the last byte to shift out, drop what was received
+        while (spi_is_busy(spi_instance)) {
+            tight_loop_contents();
+        }
+        while (spi_is_readable(spi_instance)) {
+            dma_drain_byte = (uint8_t)hw->dr;
+        }
+        hw->icr = SPI_SSPICR_RORIC_BITS;
+    }
+    
+    if (crc != NULL) {
+        *crc = (uint16_t)dma_sniffer_get_data_accumulator();
+        dma_sniffer_disable();
+    }
+    
+    return success;
+}
+
+/**
+ * @brief Add one wait to the statistics
+ */
+static void sd_wait_record(sd_wait_kind_t kind, uint64_t start_us) {
+    uint32_t elapsed = (uint32_t)(time_us_64() - start_us);
+    sd_wait_stats_t *stats = &card_info.wait[kind];
+    
+    stats->count++;
+    stats->total_us += elapsed;
+    if (elapsed > stats->max_us) {
+        stats->max_us = elapsed;
+    }
+}
+
+/**
+ * @brief Poll the card until it stops (or starts) sending 0xFF
+ * @param until_idle true: wait for 0xFF (busy ends), false: wait for a token
+ * @param last Last byte received
+ * @return false on timeout
+ * 
+ * Short waits are spun out; longer ones (card programming, read access)
+ * poll once per tick with the task blocked in between, so the USB task
+ * keeps running while the card is busy.
+ */
+static bool sd_poll_card(bool until_idle, uint32_t timeout_ms, sd_wait_kind_t kind, uint8_t *last) {
+    uint64_t start = time_us_64();
+    uint64_t deadline = start + (uint64_t)timeout_ms * 1000;
+    bool can_yield = (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+    bool done = false;
+    
+    for (;;) {
+        uint8_t byte = spi_transfer(0xFF);
+        if (last != NULL) {
+            *last = byte;
+        }
+        if ((byte == 0xFF) == until_idle) {
+            done = true;
+            break;
+        }
+        
+        uint64_t now = time_us_64();
+        if (now >= deadline) {
+            break;
+        }
+        if (can_yield && now - start >= SD_WAIT_SPIN_US) {
+            vTaskDelay(1);
+        }
+    }
+    
+    sd_wait_record(kind, start);
+    return done;
+}
+
+/**
+ * @brief Wait for SD card ready
+ */
+static inline bool sd_wait_ready(uint32_t timeout_ms, sd_wait_kind_t kind) {
+    return sd_poll_card(true, timeout_ms, kind, NULL);
+}
+
+/**
+ * @brief Send a command packet without waiting for the card
+ */
+static inline void sd_send_packet(uint8_t cmd, uint32_t arg) {
+    uint8_t packet[SD_CMD_PACKET_BYTES];
+    sd_proto_pack_command(cmd, arg, packet);
+    spi_write_blocking(spi_instance, packet, sizeof(packet));
 }
 
 /**
@@ -81,22 +328,12 @@ static bool sd_wait_ready(uint32_t timeout_ms) {
  */
 static uint8_t sd_send_command(uint8_t cmd, uint32_t arg) {
     // Wait for card ready
-    if (!sd_wait_ready(500)) {
+    if (!sd_wait_ready(SD_BUSY_TIMEOUT_MS, SD_WAIT_COMMAND)) {
         return 0xFF;
     }
     
-    // Send command packet
-    spi_transfer(0x40 | cmd);
-    spi_transfer((uint8_t)(arg >> 24));
-    spi_transfer((uint8_t)(arg >> 16));
-    spi_transfer((uint8_t)(arg >> 8));
-    spi_transfer((uint8_t)arg);
-    
-    // CRC (only matters for CMD0 and CMD8)
-    uint8_t crc = 0xFF;
-    if (cmd == CMD0) crc = 0x95;
-    if (cmd == CMD8) crc = 0x87;
-    spi_transfer(crc);
+    // Send command packet with a valid CRC7 (checked by the card after CMD59)
+    sd_send_packet(cmd, arg);
     
     // Wait for response (not 0xFF)
     uint8_t response;
@@ -112,32 +349,31 @@ static uint8_t sd_send_command(uint8_t cmd, uint32_t arg) {
 
 /**
  * @brief Read data block from SD card
+ * @param verify_crc Compare the CRC16 sent by the card with the received data
  */
-static bool sd_read_data_block(uint8_t *buffer, uint16_t length) {
-    absolute_time_t timeout = make_timeout_time_ms(200);
+static bool sd_read_data_block(uint8_t *buffer, uint16_t length, bool verify_crc) {
+    uint16_t data_crc = 0;
     
     // Wait for start token
     uint8_t token;
-    do {
-        token = spi_transfer(0xFF);
-        if (time_reached(timeout)) {
-            return false;
-        }
-    } while (token == 0xFF);
-    
-    if (token != TOKEN_START_BLOCK) {
+    if (!sd_poll_card(false, SD_READ_TIMEOUT_MS, SD_WAIT_READ, &token) ||
+        token != TOKEN_START_BLOCK) {
         return false;
     }
     
     // Read data
-    for (uint16_t i = 0; i < length; i++) {
-        buffer[i] = spi_transfer(0xFF);
+    if (!sd_dma_transfer(NULL, buffer, length, verify_crc ? &data_crc : NULL)) {
+        return false;
     }
     
-    // Read CRC (and ignore it)
-    spi_transfer(0xFF);
-    spi_transfer(0xFF);
+    // Read CRC
+    uint16_t crc = (uint16_t)(spi_transfer(0xFF) << 8);
+    crc |= spi_transfer(0xFF);
     
+    if (verify_crc && crc != data_crc) {
+        card_info.crc_errors++;
+        return false;
+    }
     return true;
 }
 
@@ -146,7 +382,7 @@ static bool sd_read_data_block(uint8_t *buffer, uint16_t length) {
  */
 static bool sd_write_data_block(const uint8_t *buffer, uint8_t token) {
     // Wait for card ready
-    if (!sd_wait_ready(500)) {
+    if (!sd_wait_ready(SD_BUSY_TIMEOUT_MS, SD_WAIT_WRITE)) {
         return false;
     }
     
@@ -154,27 +390,179 @@ static bool sd_write_data_block(const uint8_t *buffer, uint8_t token) {
     spi_transfer(token);
     
     if (token != TOKEN_STOP_MULTI) {
-        // Send data
-        for (uint16_t i = 0; i < 512; i++) {
-            spi_transfer(buffer[i]);
+        // Send data, CRC is computed on the fly (ignored by the card without CMD59)
+        uint16_t crc = 0xFFFF;
+        if (!sd_dma_transfer(buffer, NULL, 512, SD_CRC_CHECK ? &crc : NULL)) {
+            return false;
         }
         
-        // Send dummy CRC
-        spi_transfer(0xFF);
-        spi_transfer(0xFF);
+        spi_transfer((uint8_t)(crc >> 8));
+        spi_transfer((uint8_t)crc);
         
         // Check response
-        uint8_t response = spi_transfer(0xFF);
-        if ((response & 0x1F) != 0x05) {
+        uint8_t response = spi_transfer(0xFF) & 0x1F;
+        if (response != DATA_RESP_ACCEPTED) {
+            card_info.write_errors++;
+            if (response == DATA_RESP_CRC_ERROR) {
+                card_info.crc_errors++;
+            }
             return false;
         }
         
         // Wait for write completion
-        if (!sd_wait_ready(500)) {
+        if (!sd_wait_ready(SD_BUSY_TIMEOUT_MS, SD_WAIT_WRITE)) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Read a few blocks at the current clock and check their CRCs
+ */
+static bool sd_probe_clock(void) {
+    static uint8_t probe_buffer[512];
+    
+    for (uint32_t i = 0; i < SD_SPI_PROBE_READS; i++) {
+        uint32_t block = i % 4;
+        uint32_t address = (card_info.type == SD_CARD_TYPE_SDHC) ? block : block * 512;
+        
+        cs_select();
+        bool success = (sd_send_command(CMD17, address) == R1_READY_STATE) &&
+                       sd_read_data_block(probe_buffer, sizeof(probe_buffer), true);
+        cs_deselect();
+        
+        if (!success) {
             return false;
         }
     }
+    return true;
+}
+
+/**
+ * @brief Pick the fastest SPI clock that reads reliably
+ * 
+ * Starts at a safe rate and steps up to the lower of the card limit
+ * (CSD TRAN_SPEED), SD_SPI_MAX_HZ and the peripheral limit (clk_peri / 2).
+ * Each step is accepted only if CRC-checked test reads pass; the first
+ * failure falls back to the last good rate.
+ */
+static uint32_t sd_negotiate_clock(void) {
+    // Candidate rates; spi_set_baudrate() rounds each down to a clk_peri divisor
+    static const uint32_t ladder_hz[] = {
+        12500000, 16000000, 20000000, 25000000, 31250000, 37500000, 50000000, 62500000
+    };
+    
+    uint32_t limit = clock_get_hz(clk_peri) / 2;
+    uint32_t card_hz = sd_proto_csd_tran_speed_hz(card_info.csd);
+    if (card_hz != 0 && card_hz < limit) {
+        limit = card_hz;
+    }
+    if (SD_SPI_MAX_HZ < limit) {
+        limit = SD_SPI_MAX_HZ;
+    }
+    
+    printf("[SD] Clock limit %lu kHz (card %lu kHz)\n", limit / 1000, card_hz / 1000);
+    
+    uint32_t good_request = (SD_SPI_SAFE_HZ < limit) ? SD_SPI_SAFE_HZ : limit;
+    uint32_t good_hz = spi_set_baudrate(spi_instance, good_request);
+    if (!sd_probe_clock()) {
+        // Even the safe rate fails: leave it to the regular retries
+        printf("[SD] Test reads failed at %lu kHz\n", good_hz / 1000);
+        return good_hz;
+    }
+    
+    for (size_t i = 0; i < sizeof(ladder_hz) / sizeof(ladder_hz[0]); i++) {
+        if (ladder_hz[i] <= good_hz || ladder_hz[i] > limit) {
+            continue;
+        }
+        
+        uint32_t hz = spi_set_baudrate(spi_instance, ladder_hz[i]);
+        if (hz <= good_hz) {
+            continue;   // Same divisor as an already tested rate
+        }
+        if (!sd_probe_clock()) {
+            printf("[SD] Test reads failed at %lu kHz\n", hz / 1000);
+            break;
+        }
+        good_request = ladder_hz[i];
+        good_hz = hz;
+    }
+    
+    return spi_set_baudrate(spi_instance, good_request);
+}
+
+/**
+ * @brief Close the open multi-block write, if any
+ * @return false if the card did not finish programming in time
+ */
+static bool sd_stream_close(void) {
+    if (!stream_active) {
+        return true;
+    }
+    
+    stream_active = false;
+    
+    // Stop token, then the card stays busy until the last block is programmed
+    sd_write_data_block(NULL, TOKEN_STOP_MULTI);
+    spi_transfer(0xFF); // Skip stuff byte
+    bool success = sd_wait_ready(SD_BUSY_TIMEOUT_MS, SD_WAIT_WRITE);
+    
+    cs_deselect();
+    return success;
+}
+
+/**
+ * @brief Stop the open multi-block read, if any
+ */
+static void sd_read_stream_close(void) {
+    if (!read_stream_active) {
+        return;
+    }
+    
+    read_stream_active = false;
+    
+    // The card is mid-stream and not idle: send CMD12 right away
+    sd_send_packet(CMD12, 0);
+    spi_transfer(0xFF); // Skip stuff byte
+    for (int i = 0; i < 10 && spi_transfer(0xFF) == 0xFF; i++) {
+        // Wait for R1
+    }
+    sd_wait_ready(SD_BUSY_TIMEOUT_MS, SD_WAIT_COMMAND);
     
+    cs_deselect();
+}
+
+/**
+ * @brief Close both open-ended sessions before a different kind of access
+ */
+static bool sd_close_streams(void) {
+    sd_read_stream_close();
+    return sd_stream_close();
+}
+
+/**
+ * @brief Start CMD25 at a block, pre-erasing the blocks known to follow
+ */
+static bool sd_stream_open(uint32_t block, uint32_t pre_erase) {
+    uint32_t address = (card_info.type == SD_CARD_TYPE_SDHC) ? block : block * 512;
+    
+    cs_select();
+    
+    // ACMD23 is only a hint; a card that rejects it still accepts CMD25
+    if (pre_erase > 1) {
+        sd_send_command(CMD55, 0);
+        sd_send_command(CMD23, pre_erase & 0x7FFFFF);
+    }
+    
+    if (sd_send_command(CMD25, address) != R1_READY_STATE) {
+        cs_deselect();
+        return false;
+    }
+    
+    stream_active = true;
+    stream_next_block = block;
     return true;
 }
 
@@ -186,11 +574,14 @@ bool sd_card_init(spi_inst_t *spi, uint cs) {
     cs_pin = cs;
     
     memset(&card_info, 0, sizeof(card_info));
+    stream_active = false;
+    read_stream_active = false;
+    sd_dma_init();
     
     printf("[SD] Initializing SD card...\n");
     
     // Setup SPI at low speed (400 kHz for initialization)
-    spi_init(spi_instance, 400 * 1000);
+    spi_init(spi_instance, SD_SPI_INIT_HZ);
     
     // Setup CS pin
     gpio_init(cs_pin);
@@ -228,18 +619,20 @@ bool sd_card_init(spi_inst_t *spi, uint cs) {
         if (ocr[2] == 0x01 && ocr[3] == 0xAA) {
             // Valid response, try to initialize
             retry = 0;
-            do {
+            while (true) {
                 // Send ACMD41 with HCS bit
                 sd_send_command(CMD55, 0);
                 r1 = sd_send_command(ACMD41, 0x40000000);
-                retry++;
-                sleep_ms(10);
-                if (retry > 100) {
+                if (r1 == R1_READY_STATE) {
+                    break;
+                }
+                if (++retry > SD_INIT_TIMEOUT_MS / SD_INIT_POLL_MS) {
                     printf("[SD] ACMD41 timeout\n");
                     cs_deselect();
                     return false;
                 }
-            } while (r1 != R1_READY_STATE);
+                vTaskDelay(pdMS_TO_TICKS(SD_INIT_POLL_MS));
+            }
             
             // Read OCR to check card type
             if (sd_send_command(CMD58, 0) == R1_READY_STATE) {
@@ -259,17 +652,19 @@ bool sd_card_init(spi_inst_t *spi, uint cs) {
     } else {
         // SD v1.x or MMC
         retry = 0;
-        do {
+        while (true) {
             sd_send_command(CMD55, 0);
             r1 = sd_send_command(ACMD41, 0);
-            retry++;
-            sleep_ms(10);
-            if (retry > 100) {
+            if (r1 == R1_READY_STATE) {
+                break;
+            }
+            if (++retry > SD_INIT_TIMEOUT_MS / SD_INIT_POLL_MS) {
                 printf("[SD] SD v1 init failed\n");
                 cs_deselect();
                 return false;
             }
-        } while (r1 != R1_READY_STATE);
+            vTaskDelay(pdMS_TO_TICKS(SD_INIT_POLL_MS));
+        }
         
         card_info.type = SD_CARD_TYPE_SD1;
         printf("[SD] Card type: SD v1\n");
@@ -282,31 +677,17 @@ bool sd_card_init(spi_inst_t *spi, uint cs) {
         }
     }
     
+#if SD_CRC_CHECK
+    // Enable CRC checking of commands and data by the card
+    if (sd_send_command(CMD59, 1) != R1_READY_STATE) {
+        printf("[SD] CMD59 failed, CRC checking disabled by card\n");
+    }
+#endif
+    
     // Read CSD register
     if (sd_send_command(CMD9, 0) == R1_READY_STATE) {
-        if (sd_read_data_block(card_info.csd, 16)) {
-            // Calculate capacity
-            if (card_info.type == SD_CARD_TYPE_SDHC) {
-                // SDHC/SDXC: C_SIZE is 22 bits
-                uint32_t c_size = ((uint32_t)card_info.csd[7] << 16) |
-                                 ((uint32_t)card_info.csd[8] << 8) |
-                                 card_info.csd[9];
-                c_size = (c_size >> 0) & 0x3FFFFF;
-                card_info.sectors = (c_size + 1) * 1024;
-            } else {
-                // SD v1/v2: Calculate from C_SIZE, C_SIZE_MULT, READ_BL_LEN
-                uint16_t c_size = ((uint16_t)(card_info.csd[6] & 0x03) << 10) |
-                                 ((uint16_t)card_info.csd[7] << 2) |
-                                 ((card_info.csd[8] & 0xC0) >> 6);
-                uint8_t c_size_mult = ((card_info.csd[9] & 0x03) << 1) |
-                                     ((card_info.csd[10] & 0x80) >> 7);
-                uint8_t read_bl_len = card_info.csd[5] & 0x0F;
-                
-                uint32_t block_nr = (c_size + 1) * (1 << (c_size_mult + 2));
-                uint32_t block_len = 1 << read_bl_len;
-                card_info.sectors = (block_nr * block_len) / 512;
-            }
-            
+        if (sd_read_data_block(card_info.csd, 16, SD_CRC_CHECK)) {
+            card_info.sectors = sd_proto_csd_sectors(card_info.csd);
             card_info.capacity_mb = (card_info.sectors / 2) / 1024;
             printf("[SD] Capacity: %lu MB (%lu sectors)\n", 
                    card_info.capacity_mb, card_info.sectors);
@@ -315,14 +696,26 @@ bool sd_card_init(spi_inst_t *spi, uint cs) {
     
     // Read CID register
     if (sd_send_command(CMD10, 0) == R1_READY_STATE) {
-        sd_read_data_block(card_info.cid, 16);
+        sd_read_data_block(card_info.cid, 16, SD_CRC_CHECK);
     }
     
     cs_deselect();
     
-    // Increase SPI speed to maximum (12.5 MHz for RP2040)
-    spi_set_baudrate(spi_instance, 12500 * 1000);
-    printf("[SD] SPI speed set to 12.5 MHz\n");
+    if (known_clock_hz != 0 && memcmp(card_info.cid, known_cid, sizeof(known_cid)) == 0) {
+        // Same card as before: the clock it passed with is still good
+        spi_set_baudrate(spi_instance, known_clock_hz);
+        card_info.clock_hz = known_clock_hz;
+        printf("[SD] Same card, reusing %lu kHz\n", card_info.clock_hz / 1000);
+    } else {
+        // Raise SPI speed as far as the card and wiring allow
+        card_info.clock_hz = sd_negotiate_clock();
+        card_info.crc_errors = 0;   // Failures while probing are expected
+        memset(card_info.wait, 0, sizeof(card_info.wait));
+        printf("[SD] SPI speed set to %lu kHz\n", card_info.clock_hz / 1000);
+        
+        memcpy(known_cid, card_info.cid, sizeof(known_cid));
+        known_clock_hz = card_info.clock_hz;
+    }
     
     card_info.initialized = true;
     printf("[SD] Initialization complete\n");
@@ -334,10 +727,70 @@ bool sd_card_init(spi_inst_t *spi, uint cs) {
  * @brief Deinitialize SD card
  */
 void sd_card_deinit(void) {
+    if (card_info.initialized) {
+        sd_close_streams();
+    }
     card_info.initialized = false;
     spi_instance = NULL;
 }
 
+/**
+ * @brief Check that the card still answers (CMD13)
+ */
+bool sd_card_probe(void) {
+    if (!card_info.initialized) {
+        return false;
+    }
+    
+    sd_close_streams();
+    
+    // R2: R1 followed by a second status byte; a removed card leaves MISO high
+    cs_select();
+    uint8_t r1 = sd_send_command(CMD13, 0);
+    spi_transfer(0xFF);
+    cs_deselect();
+    
+    return !(r1 & 0x80) && r1 != R1_IDLE_STATE;
+}
+
+/**
+ * @brief Finish outstanding writes and read back the card status
+ */
+bool sd_card_sync(void) {
+    if (!card_info.initialized) {
+        return false;
+    }
+    
+    bool success = sd_close_streams();
+    if (!write_unsynced) {
+        return success;
+    }
+    write_unsynced = false;
+    
+    // The R2 byte reports errors found while programming (ECC, CC, WP violation)
+    cs_select();
+    uint8_t r1 = sd_send_command(CMD13, 0);
+    uint8_t r2 = spi_transfer(0xFF);
+    cs_deselect();
+    
+    if (r1 != R1_READY_STATE || (r2 & 0xFE)) {
+        printf("[SD] Sync status error (R1 0x%02x, R2 0x%02x)\n", r1, r2);
+        card_info.write_errors++;
+        return false;
+    }
+    return success;
+}
+
+/**
+ * @brief Reset error counters and wait statistics
+ */
+void sd_card_reset_stats(void) {
+    card_info.crc_errors = 0;
+    card_info.read_retries = 0;
+    card_info.write_errors = 0;
+    memset(card_info.wait, 0, sizeof(card_info.wait));
+}
+
 /**
  * @brief Check if SD card is initialized
  */
@@ -360,18 +813,28 @@ bool sd_card_read_block(uint32_t block, uint8_t *buffer) {
         return false;
     }
     
+    sd_close_streams();
+    
     // Convert block number to byte address for non-SDHC cards
     uint32_t address = (card_info.type == SD_CARD_TYPE_SDHC) ? block : block * 512;
     
-    cs_select();
-    
-    bool success = false;
-    if (sd_send_command(CMD17, address) == R1_READY_STATE) {
-        success = sd_read_data_block(buffer, 512);
+    for (int attempt = 0; attempt <= SD_READ_RETRIES; attempt++) {
+        if (attempt > 0) {
+            card_info.read_retries++;
+        }
+        
+        cs_select();
+        bool success = (sd_send_command(CMD17, address) == R1_READY_STATE) &&
+                       sd_read_data_block(buffer, 512, SD_CRC_CHECK);
+        cs_deselect();
+        
+        if (success) {
+            return true;
+        }
     }
     
-    cs_deselect();
-    return success;
+    printf("[SD] Read failed at block %lu\n", block);
+    return false;
 }
 
 /**
@@ -382,6 +845,8 @@ bool sd_card_write_block(uint32_t block, const uint8_t *buffer) {
         return false;
     }
     
+    sd_close_streams();
+    
     uint32_t address = (card_info.type == SD_CARD_TYPE_SDHC) ? block : block * 512;
     
     cs_select();
@@ -392,66 +857,132 @@ bool sd_card_write_block(uint32_t block, const uint8_t *buffer) {
     }
     
     cs_deselect();
+    write_unsynced = true;
     return success;
 }
 
+/**
+ * @brief Read blocks from the open CMD18, starting one if needed
+ * @return Number of blocks read before the first failure
+ * 
+ * The stream stays open after the last block, so a following request
+ * for the next blocks costs no command or stop latency.
+ */
+static uint32_t sd_read_blocks_once(uint32_t block, uint32_t count, uint8_t *buffer) {
+    uint32_t done = 0;
+    
+    if (read_stream_active && block != read_stream_next_block) {
+        sd_read_stream_close();
+    }
+    
+    if (!read_stream_active) {
+        uint32_t address = (card_info.type == SD_CARD_TYPE_SDHC) ? block : block * 512;
+        
+        cs_select();
+        if (sd_send_command(CMD18, address) != R1_READY_STATE) {
+            cs_deselect();
+            return 0;
+        }
+        read_stream_active = true;
+        read_stream_next_block = block;
+    }
+    
+    while (done < count && sd_read_data_block(buffer + done * 512, 512, SD_CRC_CHECK)) {
+        done++;
+        read_stream_next_block++;
+    }
+    
+    // After a failure the card position is unknown: stop and let the retry restart
+    if (done < count) {
+        sd_read_stream_close();
+    }
+    
+    return done;
+}
+
 /**
  * @brief Read multiple blocks
+ * 
+ * A failed block (CRC error, timeout) is read again with a new CMD18
+ * starting at that block; blocks before it are kept. Contiguous calls
+ * continue one CMD18 (see sd_read_blocks_once).
  */
 bool sd_card_read_blocks(uint32_t block, uint32_t count, uint8_t *buffer) {
     if (!card_info.initialized) {
         return false;
     }
     
-    uint32_t address = (card_info.type == SD_CARD_TYPE_SDHC) ? block : block * 512;
+    sd_stream_close();
     
-    cs_select();
+    uint32_t done = 0;
+    int retries = 0;
     
-    bool success = false;
-    if (sd_send_command(CMD18, address) == R1_READY_STATE) {
-        success = true;
-        for (uint32_t i = 0; i < count; i++) {
-            if (!sd_read_data_block(buffer + i * 512, 512)) {
-                success = false;
-                break;
+    while (done < count) {
+        uint32_t n = sd_read_blocks_once(block + done, count - done, buffer + done * 512);
+        done += n;
+        
+        if (done < count) {
+            if (n > 0) {
+                retries = 0;    // Progress made: the budget is per block
+            }
+            if (retries++ >= SD_READ_RETRIES) {
+                printf("[SD] Read failed at block %lu\n", block + done);
+                return false;
             }
+            card_info.read_retries++;
         }
-        
-        // Stop transmission
-        sd_send_command(CMD12, 0);
-        spi_transfer(0xFF); // Skip stuff byte
     }
     
-    cs_deselect();
-    return success;
+    return true;
 }
 
 /**
  * @brief Write multiple blocks
+ * @note One CMD25 with the whole count pre-erased (ACMD23)
  */
 bool sd_card_write_blocks(uint32_t block, uint32_t count, const uint8_t *buffer) {
+    if (!card_info.initialized || !sd_close_streams()) {
+        return false;
+    }
+    
+    bool success = sd_card_write_stream(block, count, buffer);
+    return sd_card_write_stream_end() && success;
+}
+
+/**
+ * @brief Write blocks within an open-ended multi-block write
+ */
+bool sd_card_write_stream(uint32_t block, uint32_t count, const uint8_t *buffer) {
     if (!card_info.initialized) {
         return false;
     }
     
-    uint32_t address = (card_info.type == SD_CARD_TYPE_SDHC) ? block : block * 512;
+    sd_read_stream_close();
     
-    cs_select();
+    if (stream_active && block != stream_next_block) {
+        sd_stream_close();
+    }
+    if (!stream_active && !sd_stream_open(block, count)) {
+        return false;
+    }
     
-    bool success = false;
-    if (sd_send_command(CMD25, address) == R1_READY_STATE) {
-        success = true;
-        for (uint32_t i = 0; i < count; i++) {
-            if (!sd_write_data_block(buffer + i * 512, TOKEN_START_MULTI)) {
-                success = false;
-                break;
-            }
+    write_unsynced = true;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!sd_write_data_block(buffer + i * 512, TOKEN_START_MULTI)) {
+            sd_stream_close();
+            return false;
         }
-        
-        // Stop transmission
-        sd_write_data_block(NULL, TOKEN_STOP_MULTI);
+        stream_next_block++;
     }
     
-    cs_deselect();
-    return success;
+    return true;
+}
+
+/**
+ * @brief Close the multi-block write session
+ */
+bool sd_card_write_stream_end(void) {
+    return sd_stream_close();
 }
+
+#endif // SD_BACKEND == SD_BACKEND_SPI
@@ -1,8 +1,9 @@
 /**
  * @file sd_card.h
- * @brief Low-level SD Card driver for SPI mode
+ * @brief Low-level SD Card driver
  * 
- * Supports SD, SDHC and SDXC cards in SPI mode
+ * Supports SD, SDHC and SDXC cards in SPI mode (sd_card.c) or on the
+ * native 4-bit bus via PIO (sd_sdio.c), selected by SD_BACKEND in config.h
  */
 
 #ifndef SD_CARD_H
@@ -20,11 +21,31 @@ typedef enum {
     SD_CARD_TYPE_SDHC        // SDHC/SDXC (High Capacity)
 } sd_card_type_t;
 
+// Card wait kinds for latency statistics
+typedef enum {
+    SD_WAIT_COMMAND = 0,     // Card busy before a command
+    SD_WAIT_READ,            // Read access time (command to data)
+    SD_WAIT_WRITE,           // Programming time after a data block
+    SD_WAIT_KIND_COUNT
+} sd_wait_kind_t;
+
+// Time spent waiting for the card
+typedef struct {
+    uint32_t count;          // Number of waits
+    uint64_t total_us;       // Sum of wait times
+    uint32_t max_us;         // Longest wait
+} sd_wait_stats_t;
+
 // SD Card information
 typedef struct {
     sd_card_type_t type;
     uint32_t sectors;        // Total sectors
     uint32_t capacity_mb;    // Capacity in MB
+    uint32_t clock_hz;       // Bus clock chosen at init
+    uint32_t crc_errors;     // Data blocks with a CRC mismatch (read or write)
+    uint32_t read_retries;   // Read attempts repeated after an error
+    uint32_t write_errors;   // Data blocks rejected by the card
+    sd_wait_stats_t wait[SD_WAIT_KIND_COUNT];
     uint8_t csd[16];         // Card-Specific Data
     uint8_t cid[16];         // Card Identification
     bool initialized;
@@ -43,6 +64,29 @@ bool sd_card_init(spi_inst_t *spi, uint cs_pin);
  */
 void sd_card_deinit(void);
 
+/**
+ * @brief Check that the initialized card is still there (CMD13 SEND_STATUS)
+ * @return false if the card does not answer (removed or power-cycled)
+ * 
+ * Closes any open multi-block session first, so call it while idle.
+ * sd_card_init() on the same card (same CID) skips clock negotiation.
+ */
+bool sd_card_probe(void);
+
+/**
+ * @brief Write barrier: close any write session and check the card status
+ * @return false if a write since the last sync failed or the card reports
+ *         a programming error (counted in write_errors)
+ * 
+ * Cheap when nothing was written since the last call.
+ */
+bool sd_card_sync(void);
+
+/**
+ * @brief Reset error counters and wait statistics in the card info
+ */
+void sd_card_reset_stats(void);
+
 /**
  * @brief Check if SD card is initialized
  * @return true if initialized
@@ -89,4 +133,23 @@ bool sd_card_read_blocks(uint32_t block, uint32_t count, uint8_t *buffer);
  */
 bool sd_card_write_blocks(uint32_t block, uint32_t count, const uint8_t *buffer);
 
+/**
+ * @brief Write blocks as part of an open-ended multi-block write (CMD25)
+ * @param block Starting block number
+ * @param count Number of blocks
+ * @param buffer Buffer to write from
+ * @return true on success
+ * 
+ * Continues the open session when block follows the last block written,
+ * otherwise closes it and starts a new one with count blocks pre-erased
+ * (ACMD23). Any other card access closes the session first.
+ */
+bool sd_card_write_stream(uint32_t block, uint32_t count, const uint8_t *buffer);
+
+/**
+ * @brief Close the multi-block write session and wait for programming
+ * @return true on success (also when no session is open)
+ */
+bool sd_card_write_stream_end(void);
+
 #endif // SD_CARD_H
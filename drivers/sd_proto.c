@@ -0,0 +1,234 @@
+/**
+ * @file sd_proto.c
+ * @brief SD bus protocol helpers: CRCs, command framing, response parsing
+ */
+
+#include "sd_proto.h"
+
+/**
+ * @brief CRC7 over a byte string, MSB first
+ */
+uint8_t sd_proto_crc7(const uint8_t *data, size_t length) {
+    uint8_t crc = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        uint8_t byte = data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc <<= 1;
+            if ((byte ^ crc) & 0x80) {
+                crc ^= 0x09;
+            }
+            byte <<= 1;
+        }
+    }
+
+    return crc & 0x7F;
+}
+
+/**
+ * @brief CRC16-CCITT, byte at a time without a lookup table
+ */
+uint16_t sd_proto_crc16(const uint8_t *data, size_t length) {
+    uint16_t crc = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        crc = (uint16_t)((crc >> 8) | (crc << 8));
+        crc ^= data[i];
+        crc ^= (uint8_t)(crc & 0xFF) >> 4;
+        crc ^= (uint16_t)(crc << 12);
+        crc ^= (uint16_t)((crc & 0xFF) << 5);
+    }
+
+    return crc;
+}
+
+/**
+ * @brief One nibble step of four CRC16s kept interleaved in 64 bits
+ *
+ * Bit k of every nibble belongs to DAT line k, so nibble 15 holds the
+ * MSBs of all four CRCs and the polynomial taps (bits 0, 5, 12) become
+ * nibble shifts.
+ */
+static inline uint64_t crc16_4bit_step(uint64_t crc, uint8_t nibble) {
+    uint64_t feedback = (crc >> 60) ^ nibble;
+    crc <<= 4;
+    return crc ^ feedback ^ (feedback << 20) ^ (feedback << 48);
+}
+
+/**
+ * @brief CRC16 of four DAT lines; high nibble of each byte goes out first
+ */
+uint64_t sd_proto_crc16_4bit(const uint8_t *data, size_t length) {
+    uint64_t crc = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        crc = crc16_4bit_step(crc, data[i] >> 4);
+        crc = crc16_4bit_step(crc, data[i] & 0x0F);
+    }
+
+    return crc;
+}
+
+/**
+ * @brief Store interleaved CRCs in bus order (big-endian)
+ */
+void sd_proto_put_crc16_4bit(uint64_t crc, uint8_t out[SD_DATA4_CRC_BYTES]) {
+    for (int i = 0; i < SD_DATA4_CRC_BYTES; i++) {
+        out[i] = (uint8_t)(crc >> (56 - 8 * i));
+    }
+}
+
+/**
+ * @brief Compare the CRC of a received block with the one sent by the card
+ */
+bool sd_proto_check_crc16_4bit(const uint8_t *data, size_t length,
+                               const uint8_t crc[SD_DATA4_CRC_BYTES]) {
+    uint8_t expected[SD_DATA4_CRC_BYTES];
+    sd_proto_put_crc16_4bit(sd_proto_crc16_4bit(data, length), expected);
+
+    for (int i = 0; i < SD_DATA4_CRC_BYTES; i++) {
+        if (expected[i] != crc[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Build a command packet: 01 + index, argument MSB first, CRC7 + end bit
+ */
+void sd_proto_pack_command(uint8_t cmd, uint32_t arg, uint8_t packet[SD_CMD_PACKET_BYTES]) {
+    packet[0] = 0x40 | (cmd & 0x3F);
+    packet[1] = (uint8_t)(arg >> 24);
+    packet[2] = (uint8_t)(arg >> 16);
+    packet[3] = (uint8_t)(arg >> 8);
+    packet[4] = (uint8_t)arg;
+    packet[5] = (uint8_t)((sd_proto_crc7(packet, 5) << 1) | 0x01);
+}
+
+/**
+ * @brief Response length on the CMD line
+ */
+uint32_t sd_proto_response_bits(sd_resp_type_t type) {
+    switch (type) {
+        case SD_RESP_NONE: return 0;
+        case SD_RESP_R2:   return SD_RESP_LONG_BITS;
+        default:           return SD_RESP_SHORT_BITS;
+    }
+}
+
+/**
+ * @brief Repack a bit stream captured 32 bits per word into bytes
+ */
+void sd_proto_unpack_bits(const uint32_t *words, uint32_t bits, uint8_t *out) {
+    uint32_t full_words = bits / 32;
+    uint32_t tail_bits = bits % 32;
+
+    for (uint32_t i = 0; i < (bits + 7) / 8; i++) {
+        out[i] = 0;
+    }
+
+    for (uint32_t n = 0; n < bits; n++) {
+        uint32_t word = n / 32;
+        uint32_t shift = (word < full_words) ? 31 - (n % 32) : tail_bits - 1 - (n % 32);
+        if ((words[word] >> shift) & 1) {
+            out[n / 8] |= (uint8_t)(0x80 >> (n % 8));
+        }
+    }
+}
+
+static inline uint32_t get_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * @brief Validate framing, index and CRC of a response
+ */
+sd_proto_result_t sd_proto_parse_response(sd_resp_type_t type, uint8_t cmd,
+                                          const uint8_t *resp, uint32_t *value) {
+    if (type == SD_RESP_R2) {
+        // 0 0 111111, register bits 127..1 (CRC7 in the last byte), end bit
+        if (resp[0] != 0x3F || !(resp[16] & 0x01)) {
+            return SD_PROTO_ERR_FRAME;
+        }
+        if (sd_proto_crc7(&resp[1], 15) != (resp[16] >> 1)) {
+            return SD_PROTO_ERR_CRC;
+        }
+        return SD_PROTO_OK;
+    }
+
+    if ((resp[0] & 0xC0) != 0 || !(resp[5] & 0x01)) {
+        return SD_PROTO_ERR_FRAME;
+    }
+
+    uint32_t payload = get_be32(&resp[1]);
+    if (value != NULL) {
+        *value = payload;
+    }
+
+    if (type == SD_RESP_R3) {
+        // Index and CRC fields are all ones for R3
+        return ((resp[0] & 0x3F) == 0x3F) ? SD_PROTO_OK : SD_PROTO_ERR_INDEX;
+    }
+
+    if ((resp[0] & 0x3F) != (cmd & 0x3F)) {
+        return SD_PROTO_ERR_INDEX;
+    }
+    if (sd_proto_crc7(resp, 5) != (resp[5] >> 1)) {
+        return SD_PROTO_ERR_CRC;
+    }
+
+    switch (type) {
+        case SD_RESP_R1:
+        case SD_RESP_R1B:
+            return (payload & SD_STATUS_ERROR_MASK) ? SD_PROTO_ERR_STATUS : SD_PROTO_OK;
+        case SD_RESP_R6:
+            // Status bits 15..13 mirror COM_CRC_ERROR, ILLEGAL_COMMAND, ERROR
+            return (payload & 0xE000) ? SD_PROTO_ERR_STATUS : SD_PROTO_OK;
+        default:
+            return SD_PROTO_OK;
+    }
+}
+
+/**
+ * @brief Decode C_SIZE according to the CSD structure version
+ */
+uint32_t sd_proto_csd_sectors(const uint8_t csd[16]) {
+    if ((csd[0] >> 6) == 1) {
+        // CSD v2 (SDHC/SDXC): 22-bit C_SIZE in 512 KB units
+        uint32_t c_size = ((uint32_t)(csd[7] & 0x3F) << 16) |
+                          ((uint32_t)csd[8] << 8) |
+                          csd[9];
+        return (c_size + 1) * 1024;
+    }
+
+    // CSD v1: C_SIZE, C_SIZE_MULT, READ_BL_LEN
+    uint16_t c_size = ((uint16_t)(csd[6] & 0x03) << 10) |
+                      ((uint16_t)csd[7] << 2) |
+                      ((csd[8] & 0xC0) >> 6);
+    uint8_t c_size_mult = ((csd[9] & 0x03) << 1) | ((csd[10] & 0x80) >> 7);
+    uint8_t read_bl_len = csd[5] & 0x0F;
+
+    uint32_t block_nr = (uint32_t)(c_size + 1) * (1u << (c_size_mult + 2));
+    uint32_t block_len = 1u << read_bl_len;
+    return (block_nr * block_len) / 512;
+}
+
+/**
+ * @brief Decode TRAN_SPEED: time value (bits 6:3) times rate unit (bits 2:0)
+ */
+uint32_t sd_proto_csd_tran_speed_hz(const uint8_t csd[16]) {
+    // Time values are in tenths: 1.0, 1.2, 1.3, ... 8.0
+    static const uint8_t time_value[16] = {
+        0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80
+    };
+    static const uint32_t unit_hz[4] = { 10000, 100000, 1000000, 10000000 };
+
+    uint8_t tran_speed = csd[3];
+    uint8_t unit = tran_speed & 0x07;
+
+    if (unit >= 4) {
+        return 0;   // Reserved units
+    }
+    return time_value[(tran_speed >> 3) & 0x0F] * unit_hz[unit];
+}
@@ -0,0 +1,126 @@
+/**
+ * @file sd_proto.h
+ * @brief SD bus protocol helpers: CRCs, command framing, response parsing
+ *
+ * Pure C with no SDK dependencies, shared by the SPI and SDIO backends
+ * and buildable on a host for testing against a software card model.
+ */
+
+#ifndef SD_PROTO_H
+#define SD_PROTO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SD_BLOCK_SIZE           512
+
+// Command packet and response sizes on the CMD line
+#define SD_CMD_PACKET_BYTES     6       // Start, index, argument, CRC7, end
+#define SD_RESP_SHORT_BITS      48      // R1, R1b, R3, R6, R7
+#define SD_RESP_LONG_BITS       136     // R2 (CID/CSD)
+
+// 4-bit data framing: 512 data bytes plus 16 bits of CRC per DAT line
+#define SD_DATA4_CRC_BYTES      8
+#define SD_DATA4_NIBBLES        ((SD_BLOCK_SIZE + SD_DATA4_CRC_BYTES) * 2)
+
+// Card status (R1) bits
+#define SD_STATUS_ERROR_MASK    0xFDF98008u     // Error and exception bits
+#define SD_STATUS_READY_FOR_DATA (1u << 8)
+#define SD_STATUS_APP_CMD       (1u << 5)
+#define SD_STATUS_STATE(s)      (((s) >> 9) & 0x0F)
+
+// OCR bits
+#define SD_OCR_BUSY             (1u << 31)      // Power-up complete (active low busy)
+#define SD_OCR_CCS              (1u << 30)      // Card capacity status (SDHC/SDXC)
+#define SD_OCR_VOLTAGE_3V3      0x00FF8000u     // 2.7-3.6 V window
+
+// Response formats
+typedef enum {
+    SD_RESP_NONE = 0,
+    SD_RESP_R1,
+    SD_RESP_R1B,            // R1 followed by busy on DAT0
+    SD_RESP_R2,             // CID/CSD register
+    SD_RESP_R3,             // OCR, no CRC
+    SD_RESP_R6,             // Published RCA
+    SD_RESP_R7              // Interface condition echo
+} sd_resp_type_t;
+
+typedef enum {
+    SD_PROTO_OK = 0,
+    SD_PROTO_ERR_FRAME,     // Start/transmission/end bits wrong
+    SD_PROTO_ERR_INDEX,     // Response to a different command
+    SD_PROTO_ERR_CRC,       // CRC7 mismatch
+    SD_PROTO_ERR_STATUS     // Card reported an error in its status
+} sd_proto_result_t;
+
+/**
+ * @brief CRC7 (x^7 + x^3 + 1) as used by commands and responses
+ * @return 7-bit CRC in the low bits
+ */
+uint8_t sd_proto_crc7(const uint8_t *data, size_t length);
+
+/**
+ * @brief CRC16-CCITT (x^16 + x^12 + x^5 + 1) of one data line
+ */
+uint16_t sd_proto_crc16(const uint8_t *data, size_t length);
+
+/**
+ * @brief CRC16 of all four DAT lines of a 4-bit bus transfer
+ * @return Four interleaved CRCs; bytes of the value in big-endian order
+ *         are the 16 CRC nibbles exactly as they appear on the bus
+ */
+uint64_t sd_proto_crc16_4bit(const uint8_t *data, size_t length);
+
+/**
+ * @brief Store a 4-bit bus CRC as transmitted after the data
+ */
+void sd_proto_put_crc16_4bit(uint64_t crc, uint8_t out[SD_DATA4_CRC_BYTES]);
+
+/**
+ * @brief Check a received 4-bit bus block against the CRC sent by the card
+ */
+bool sd_proto_check_crc16_4bit(const uint8_t *data, size_t length,
+                               const uint8_t crc[SD_DATA4_CRC_BYTES]);
+
+/**
+ * @brief Build the 48-bit command packet including CRC7 and end bit
+ */
+void sd_proto_pack_command(uint8_t cmd, uint32_t arg, uint8_t packet[SD_CMD_PACKET_BYTES]);
+
+/**
+ * @brief Number of response bits on the CMD line for a response type
+ */
+uint32_t sd_proto_response_bits(sd_resp_type_t type);
+
+/**
+ * @brief Convert MSB-first bit stream words into bytes
+ * @param words Words as shifted in (full words first, last word right-aligned)
+ * @param bits Total number of bits
+ * @param out Output, (bits + 7) / 8 bytes
+ */
+void sd_proto_unpack_bits(const uint32_t *words, uint32_t bits, uint8_t *out);
+
+/**
+ * @brief Validate a response and extract its payload
+ * @param type Expected response format
+ * @param cmd Command index the response belongs to
+ * @param resp Response bytes (6 for short, 17 for R2)
+ * @param value Card status (R1/R1b), OCR (R3), RCA << 16 | status (R6),
+ *              echo argument (R7); unused for R2 (register is resp + 1)
+ */
+sd_proto_result_t sd_proto_parse_response(sd_resp_type_t type, uint8_t cmd,
+                                          const uint8_t *resp, uint32_t *value);
+
+/**
+ * @brief Card capacity in 512-byte sectors from the CSD register (v1 or v2)
+ */
+uint32_t sd_proto_csd_sectors(const uint8_t csd[16]);
+
+/**
+ * @brief Maximum bus clock of the current mode from CSD TRAN_SPEED
+ * @return Clock in Hz (25 MHz for most cards in default speed), 0 if invalid
+ */
+uint32_t sd_proto_csd_tran_speed_hz(const uint8_t csd[16]);
+
+#endif // SD_PROTO_H
@@ -0,0 +1,911 @@
+/**
+ * @file sd_sdio.c
+ * @brief SD card driver for the native 4-bit SD bus using PIO and DMA
+ *
+ * Implements the same sd_card_* API as the SPI driver; the backend is
+ * selected with SD_BACKEND in config.h. Protocol framing (CRCs, command
+ * packets, response parsing) lives in sd_proto.c.
+ */
+
+#include "config.h"
+
+#if SD_BACKEND == SD_BACKEND_SDIO
+
+#include "sd_card.h"
+#include "sd_proto.h"
+#include "sd_sdio.pio.h"
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+#include <stdio.h>
+
+// SD Card Commands (SD bus mode)
+#define CMD0    0       // GO_IDLE_STATE
+#define CMD2    2       // ALL_SEND_CID
+#define CMD3    3       // SEND_RELATIVE_ADDR
+#define CMD7    7       // SELECT_CARD
+#define CMD8    8       // SEND_IF_COND
+#define CMD9    9       // SEND_CSD
+#define CMD12   12      // STOP_TRANSMISSION
+#define CMD13   13      // SEND_STATUS
+#define CMD16   16      // SET_BLOCKLEN
+#define CMD17   17      // READ_SINGLE_BLOCK
+#define CMD18   18      // READ_MULTIPLE_BLOCK
+#define CMD24   24      // WRITE_BLOCK
+#define CMD25   25      // WRITE_MULTIPLE_BLOCK
+#define CMD55   55      // APP_CMD
+#define ACMD6   6       // SET_BUS_WIDTH
+#define ACMD23  23      // SET_WR_BLK_ERASE_COUNT
+#define ACMD41  41      // SD_SEND_OP_COND
+
+// Bus clock
+#define SDIO_CLK_INIT_HZ        400000
+#define SDIO_CLK_DEFAULT_HZ     25000000
+
+// Timeouts
+#define SDIO_CMD_TIMEOUT_US     5000    // Command + response at 400 kHz is ~0.7 ms
+#define SDIO_READ_TIMEOUT_MS    100     // Read access time limit
+#define SDIO_BUSY_TIMEOUT_MS    500     // Write/erase busy limit
+#define SDIO_WAIT_SPIN_US       50      // Busy waits shorter than this are spun out
+#define SDIO_INIT_POLL_MS       1       // ACMD41 polling period
+#define SDIO_INIT_TIMEOUT_MS    1000    // Spec limit for ACMD41 initialization
+
+#define SDIO_MAX_READ_BLOCKS    32      // Blocks per CMD18 (CRCs captured by DMA)
+#define SDIO_DMA_NOTIFY_INDEX   1       // Task notification slot used for DMA completion
+#define SDIO_CRC_ACCEPTED       0x5     // CRC status token 010 + end bit
+#define SDIO_CRC_REJECTED       0xB     // CRC status token 101 + end bit
+#define SDIO_READ_RETRIES       3       // Extra attempts for a chunk that failed to read
+
+// PIO placement: CMD + RX fill one block, CLK + TX the other
+#define SDIO_PIO_CMD            pio0
+#define SDIO_PIO_DATA_TX        pio1
+
+static uint sm_cmd, sm_rx, sm_clk, sm_tx;
+static uint offset_cmd, offset_rx, offset_clk, offset_tx;
+static bool hw_ready = false;
+
+static int dma_data_chan = -1;
+static int dma_crc_chan = -1;
+static volatile int dma_count_chan = -1;            // Channel counting finished blocks
+static volatile uint32_t dma_blocks_left = 0;
+static TaskHandle_t volatile dma_waiter = NULL;
+
+static sd_card_info_t card_info = {0};
+static uint32_t card_rca = 0;
+static uint32_t clock_hz = 0;
+
+// Open-ended multi-block write (CMD25 kept open between calls)
+static bool stream_active = false;
+static uint32_t stream_next_block = 0;
+
+// Data accepted since the last sd_card_sync(), status not checked yet
+static bool write_unsynced = false;
+
+// CRCs of a multi-block read and a bounce buffer for unaligned requests
+static uint8_t read_crc[SDIO_MAX_READ_BLOCKS][SD_DATA4_CRC_BYTES] __attribute__((aligned(4)));
+static uint8_t bounce[SD_BLOCK_SIZE] __attribute__((aligned(4)));
+
+/**
+ * @brief DMA completion interrupt: count blocks, wake the waiting task on the last one
+ */
+static void sdio_dma_irq_handler(void) {
+    int chan = dma_count_chan;
+    if (chan < 0 || !dma_channel_get_irq1_status(chan)) {
+        return;  // Shared IRQ raised by another channel
+    }
+    dma_channel_acknowledge_irq1(chan);
+
+    if (dma_blocks_left > 0 && --dma_blocks_left == 0 && dma_waiter != NULL) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveIndexedFromISR(dma_waiter, SDIO_DMA_NOTIFY_INDEX, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+/**
+ * @brief Arm the completion counter before starting DMA
+ */
+static void sdio_dma_arm(int chan, uint32_t blocks) {
+    dma_blocks_left = blocks;
+    dma_count_chan = chan;
+
+    // Status left by an aborted transfer would count as a finished block
+    dma_channel_acknowledge_irq1(chan);
+    dma_channel_set_irq1_enabled(chan, true);
+
+    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+        dma_waiter = xTaskGetCurrentTaskHandle();
+        // A late IRQ of a timed-out transfer leaves the count at 1: clear the value, not just the state
+        ulTaskNotifyValueClearIndexed(NULL, SDIO_DMA_NOTIFY_INDEX, UINT32_MAX);
+        xTaskNotifyStateClearIndexed(NULL, SDIO_DMA_NOTIFY_INDEX);
+    } else {
+        dma_waiter = NULL;
+    }
+}
+
+/**
+ * @brief Wait until all armed blocks are transferred
+ * @note Sleeps on a notification when the scheduler runs, busy-waits otherwise
+ */
+static bool sdio_dma_wait(uint32_t timeout_ms) {
+    bool success = true;
+
+    if (dma_waiter != NULL) {
+        if (ulTaskNotifyTakeIndexed(SDIO_DMA_NOTIFY_INDEX, pdTRUE, pdMS_TO_TICKS(timeout_ms)) == 0) {
+            success = (dma_blocks_left == 0);
+        }
+    } else {
+        absolute_time_t timeout = make_timeout_time_ms(timeout_ms);
+        while (dma_blocks_left > 0) {
+            if (time_reached(timeout)) {
+                success = false;
+                break;
+            }
+        }
+    }
+
+    dma_channel_set_irq1_enabled(dma_count_chan, false);
+    dma_count_chan = -1;
+    dma_waiter = NULL;
+    return success;
+}
+
+/**
+ * @brief Stop a channel and drop the IRQ status the abort may leave behind
+ * @note Called after sdio_dma_wait(), with the channel IRQ already disabled
+ */
+static void sdio_dma_abort(int chan) {
+    dma_channel_abort(chan);
+    dma_channel_acknowledge_irq1(chan);
+}
+
+/**
+ * @brief Load a program, pointing its "wait gpio" instructions at the CLK pin
+ */
+static uint sdio_add_program(PIO pio, const pio_program_t *program) {
+    uint16_t instructions[32];
+
+    for (uint i = 0; i < program->length; i++) {
+        uint16_t instr = program->instructions[i];
+        if ((instr & 0xE060) == 0x2000) {   // WAIT, source = GPIO
+            instr = (uint16_t)((instr & ~0x001F) | SD_SDIO_PIN_CLK);
+        }
+        instructions[i] = instr;
+    }
+
+    pio_program_t patched = *program;
+    patched.instructions = instructions;
+    return pio_add_program(pio, &patched);
+}
+
+/**
+ * @brief Stop a state machine and restart it from its first instruction
+ */
+static void sdio_restart_sm(PIO pio, uint sm, uint offset) {
+    pio_sm_set_enabled(pio, sm, false);
+    pio_sm_clear_fifos(pio, sm);
+    pio_sm_restart(pio, sm);
+    pio_sm_exec(pio, sm, pio_encode_jmp(offset));
+}
+
+/**
+ * @brief Hand the bus pins to the PIO blocks
+ * @note Done on every init: anything else may have remuxed the pins since
+ */
+static void sdio_pins_init(void) {
+    const uint d0 = SD_SDIO_PIN_D0;
+
+    // CMD and DAT are open-drain style lines with pull-ups; the CLK
+    // and DAT pins belong to the TX block, CMD to the CMD block
+    gpio_pull_up(SD_SDIO_PIN_CMD);
+    pio_gpio_init(SDIO_PIO_CMD, SD_SDIO_PIN_CMD);
+    pio_gpio_init(SDIO_PIO_DATA_TX, SD_SDIO_PIN_CLK);
+    for (uint i = 0; i < 4; i++) {
+        gpio_pull_up(d0 + i);
+        pio_gpio_init(SDIO_PIO_DATA_TX, d0 + i);
+    }
+}
+
+/**
+ * @brief Set up pins, PIO programs and DMA channels (programs and channels once)
+ */
+static void sdio_hw_init(void) {
+    sdio_pins_init();
+
+    if (hw_ready) {
+        return;
+    }
+
+    PIO pio_cmd = SDIO_PIO_CMD;
+    PIO pio_tx = SDIO_PIO_DATA_TX;
+    const uint d0 = SD_SDIO_PIN_D0;
+
+    offset_cmd = sdio_add_program(pio_cmd, &sd_cmd_program);
+    offset_rx = sdio_add_program(pio_cmd, &sd_data_rx_program);
+    offset_clk = sdio_add_program(pio_tx, &sd_clk_program);
+    offset_tx = sdio_add_program(pio_tx, &sd_data_tx_program);
+
+    sm_cmd = pio_claim_unused_sm(pio_cmd, true);
+    sm_rx = pio_claim_unused_sm(pio_cmd, true);
+    sm_clk = pio_claim_unused_sm(pio_tx, true);
+    sm_tx = pio_claim_unused_sm(pio_tx, true);
+
+    // Clock: free-running square wave, rate set by sdio_set_clock()
+    pio_sm_config c = sd_clk_program_get_default_config(offset_clk);
+    sm_config_set_set_pins(&c, SD_SDIO_PIN_CLK, 1);
+    pio_sm_init(pio_tx, sm_clk, offset_clk, &c);
+    pio_sm_set_consecutive_pindirs(pio_tx, sm_clk, SD_SDIO_PIN_CLK, 1, true);
+
+    // CMD: commands out MSB first, responses in MSB first
+    c = sd_cmd_program_get_default_config(offset_cmd);
+    sm_config_set_out_pins(&c, SD_SDIO_PIN_CMD, 1);
+    sm_config_set_set_pins(&c, SD_SDIO_PIN_CMD, 1);
+    sm_config_set_in_pins(&c, SD_SDIO_PIN_CMD);
+    sm_config_set_jmp_pin(&c, SD_SDIO_PIN_CMD);
+    sm_config_set_out_shift(&c, false, true, 32);
+    sm_config_set_in_shift(&c, false, true, 32);
+    pio_sm_init(pio_cmd, sm_cmd, offset_cmd, &c);
+    pio_sm_set_pins_with_mask(pio_cmd, sm_cmd, 1u << SD_SDIO_PIN_CMD, 1u << SD_SDIO_PIN_CMD);
+    pio_sm_set_consecutive_pindirs(pio_cmd, sm_cmd, SD_SDIO_PIN_CMD, 1, false);
+
+    // DAT receive: 4 bits per clock, autopush 8 nibbles
+    c = sd_data_rx_program_get_default_config(offset_rx);
+    sm_config_set_in_pins(&c, d0);
+    sm_config_set_jmp_pin(&c, d0);
+    sm_config_set_in_shift(&c, false, true, 32);
+    sm_config_set_out_shift(&c, false, false, 32);
+    pio_sm_init(pio_cmd, sm_rx, offset_rx, &c);
+
+    // DAT transmit: autopull 8 nibbles, status token pushed per block
+    c = sd_data_tx_program_get_default_config(offset_tx);
+    sm_config_set_out_pins(&c, d0, 4);
+    sm_config_set_set_pins(&c, d0, 4);
+    sm_config_set_in_pins(&c, d0);
+    sm_config_set_jmp_pin(&c, d0);
+    sm_config_set_out_shift(&c, false, true, 32);
+    sm_config_set_in_shift(&c, false, false, 32);
+    pio_sm_init(pio_tx, sm_tx, offset_tx, &c);
+    pio_sm_set_pins_with_mask(pio_tx, sm_tx, 0xFu << d0, 0xFu << d0);
+    pio_sm_set_consecutive_pindirs(pio_tx, sm_tx, d0, 4, false);
+
+    dma_data_chan = dma_claim_unused_channel(true);
+    dma_crc_chan = dma_claim_unused_channel(true);
+    irq_add_shared_handler(DMA_IRQ_1, sdio_dma_irq_handler,
+                           PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+
+    hw_ready = true;
+}
+
+/**
+ * @brief Set the bus clock
+ * @note Integer divider only: a fractional one would add jitter. The
+ *       resulting rate is never above the requested one.
+ */
+static void sdio_set_clock(uint32_t hz) {
+    uint32_t sys_hz = clock_get_hz(clk_sys);
+    uint32_t div = (sys_hz + 2 * hz - 1) / (2 * hz);
+
+    // Half period must cover the 3-cycle edge latency of the data programs,
+    // so the bus never runs above sys/6 (25 MHz at 150 MHz, 20.8 MHz at 125 MHz)
+    if (div < 3) {
+        div = 3;
+    }
+
+    pio_sm_set_clkdiv_int_frac(SDIO_PIO_DATA_TX, sm_clk, (uint16_t)div, 0);
+    clock_hz = sys_hz / (2 * div);
+}
+
+/**
+ * @brief Add one wait to the statistics
+ */
+static void sdio_wait_record(sd_wait_kind_t kind, uint64_t start_us) {
+    uint32_t elapsed = (uint32_t)(time_us_64() - start_us);
+    sd_wait_stats_t *stats = &card_info.wait[kind];
+
+    stats->count++;
+    stats->total_us += elapsed;
+    if (elapsed > stats->max_us) {
+        stats->max_us = elapsed;
+    }
+}
+
+/**
+ * @brief Spin for short waits, then block one tick per poll
+ */
+static inline void sdio_wait_pause(uint64_t start_us) {
+    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING &&
+        time_us_64() - start_us >= SDIO_WAIT_SPIN_US) {
+        vTaskDelay(1);
+    }
+}
+
+/**
+ * @brief Wait until the card releases DAT0 (busy after writes and R1b commands)
+ */
+static bool sdio_wait_ready(uint32_t timeout_ms, sd_wait_kind_t kind) {
+    uint64_t start = time_us_64();
+    absolute_time_t timeout = make_timeout_time_ms(timeout_ms);
+    bool ready = true;
+
+    while (!gpio_get(SD_SDIO_PIN_D0)) {
+        if (time_reached(timeout)) {
+            printf("[SD] Busy timeout\n");
+            ready = false;
+            break;
+        }
+        sdio_wait_pause(start);
+    }
+
+    sdio_wait_record(kind, start);
+    return ready;
+}
+
+/**
+ * @brief Send a command and receive its response
+ * @param value Payload of short responses (see sd_proto_parse_response)
+ * @param reg 16-byte register for R2 responses (CID/CSD), may be NULL
+ */
+static bool sdio_command(uint8_t cmd, uint32_t arg, sd_resp_type_t type,
+                         uint32_t *value, uint8_t *reg) {
+    PIO pio = SDIO_PIO_CMD;
+    uint8_t packet[SD_CMD_PACKET_BYTES];
+    uint32_t bits = sd_proto_response_bits(type);
+
+    sd_proto_pack_command(cmd, arg, packet);
+
+    pio_sm_put_blocking(pio, sm_cmd, SD_CMD_PACKET_BYTES * 8 - 1);
+    pio_sm_put_blocking(pio, sm_cmd, ((uint32_t)packet[0] << 24) | ((uint32_t)packet[1] << 16) |
+                                     ((uint32_t)packet[2] << 8) | packet[3]);
+    pio_sm_put_blocking(pio, sm_cmd, ((uint32_t)packet[4] << 24) | ((uint32_t)packet[5] << 16) |
+                                     (bits ? bits - 1 : 0));
+
+    if (type == SD_RESP_NONE) {
+        // Let the packet leave before the caller moves on
+        sleep_us(200);
+        return true;
+    }
+
+    uint32_t words[(SD_RESP_LONG_BITS + 31) / 32];
+    uint32_t word_count = (bits + 31) / 32;
+    absolute_time_t timeout = make_timeout_time_us(SDIO_CMD_TIMEOUT_US);
+
+    for (uint32_t i = 0; i < word_count; i++) {
+        while (pio_sm_is_rx_fifo_empty(pio, sm_cmd)) {
+            if (time_reached(timeout)) {
+                // No response (e.g. CMD8 on v1 cards): reset the CMD machine
+                sdio_restart_sm(pio, sm_cmd, offset_cmd);
+                pio_sm_set_consecutive_pindirs(pio, sm_cmd, SD_SDIO_PIN_CMD, 1, false);
+                pio_sm_set_enabled(pio, sm_cmd, true);
+                return false;
+            }
+        }
+        words[i] = pio_sm_get(pio, sm_cmd);
+    }
+
+    uint8_t resp[(SD_RESP_LONG_BITS + 7) / 8];
+    sd_proto_unpack_bits(words, bits, resp);
+
+    sd_proto_result_t result = sd_proto_parse_response(type, cmd, resp, value);
+    if (result != SD_PROTO_OK) {
+        printf("[SD] CMD%u response error %d\n", cmd, result);
+        return false;
+    }
+
+    if (type == SD_RESP_R2 && reg != NULL) {
+        memcpy(reg, &resp[1], 16);
+    }
+    if (type == SD_RESP_R1B) {
+        return sdio_wait_ready(SDIO_BUSY_TIMEOUT_MS, SD_WAIT_COMMAND);
+    }
+    return true;
+}
+
+/**
+ * @brief Send an application command (CMD55 + ACMDn)
+ */
+static bool sdio_app_command(uint8_t acmd, uint32_t arg, sd_resp_type_t type, uint32_t *value) {
+    if (!sdio_command(CMD55, card_rca << 16, SD_RESP_R1, NULL, NULL)) {
+        return false;
+    }
+    return sdio_command(acmd, arg, type, value, NULL);
+}
+
+/**
+ * @brief Read data blocks after a read command
+ * @param buffer Destination, 4-byte aligned
+ * @param block_size Bytes per block
+ *
+ * Two chained DMA channels alternate between the data of each block and
+ * its CRC, so the card can stream blocks back to back. CRCs are checked
+ * once the transfer is complete.
+ */
+static bool sdio_read_data(uint8_t cmd, uint32_t arg, uint32_t count,
+                           uint32_t block_size, uint8_t *buffer) {
+    PIO pio = SDIO_PIO_CMD;
+
+    if (!sdio_wait_ready(SDIO_BUSY_TIMEOUT_MS, SD_WAIT_COMMAND)) {
+        return false;
+    }
+
+    sdio_restart_sm(pio, sm_rx, offset_rx);
+    pio_sm_put(pio, sm_rx, count - 1);
+    pio_sm_put(pio, sm_rx, (block_size + SD_DATA4_CRC_BYTES) * 2 - 1);
+
+    dma_channel_config data_cfg = dma_channel_get_default_config(dma_data_chan);
+    channel_config_set_transfer_data_size(&data_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&data_cfg, false);
+    channel_config_set_write_increment(&data_cfg, true);
+    channel_config_set_bswap(&data_cfg, true);
+    channel_config_set_dreq(&data_cfg, pio_get_dreq(pio, sm_rx, false));
+    channel_config_set_chain_to(&data_cfg, dma_crc_chan);
+
+    dma_channel_config crc_cfg = data_cfg;
+    channel_config_set_chain_to(&crc_cfg, dma_data_chan);
+
+    // Write addresses carry over between chained runs: block after block,
+    // CRC after CRC. The rx program stops after the last block.
+    dma_channel_configure(dma_crc_chan, &crc_cfg, read_crc, pio_rxf(pio, sm_rx),
+                          SD_DATA4_CRC_BYTES / 4, false);
+    dma_channel_configure(dma_data_chan, &data_cfg, buffer, pio_rxf(pio, sm_rx),
+                          block_size / 4, true);
+
+    sdio_dma_arm(dma_crc_chan, count);
+    pio_sm_set_enabled(pio, sm_rx, true);
+
+    bool success = sdio_command(cmd, arg, SD_RESP_R1, NULL, NULL) &&
+                   sdio_dma_wait(SDIO_READ_TIMEOUT_MS + count);
+
+    sdio_dma_abort(dma_data_chan);
+    sdio_dma_abort(dma_crc_chan);
+    pio_sm_set_enabled(pio, sm_rx, false);
+
+    if (cmd == CMD18 && !sdio_command(CMD12, 0, SD_RESP_R1B, NULL, NULL)) {
+        success = false;
+    }
+
+    if (!success) {
+        printf("[SD] Read timeout (CMD%u, %lu blocks)\n", cmd, count);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!sd_proto_check_crc16_4bit(buffer + i * block_size, block_size, read_crc[i])) {
+            printf("[SD] Data CRC error in block %lu\n", i);
+            card_info.crc_errors++;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Write data blocks after CMD24/CMD25 was accepted
+ * @param buffer Source, 4-byte aligned
+ */
+static bool sdio_write_data(uint32_t count, const uint8_t *buffer) {
+    PIO pio = SDIO_PIO_DATA_TX;
+
+    sdio_restart_sm(pio, sm_tx, offset_tx);
+    pio_sm_set_consecutive_pindirs(pio, sm_tx, SD_SDIO_PIN_D0, 4, false);
+    pio_sm_set_enabled(pio, sm_tx, true);
+
+    dma_channel_config cfg = dma_channel_get_default_config(dma_data_chan);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&cfg, true);
+    channel_config_set_write_increment(&cfg, false);
+    channel_config_set_bswap(&cfg, true);
+    channel_config_set_dreq(&cfg, pio_get_dreq(pio, sm_tx, true));
+
+    bool success = true;
+    for (uint32_t i = 0; i < count && success; i++) {
+        const uint8_t *block = buffer + i * SD_BLOCK_SIZE;
+        uint64_t crc = sd_proto_crc16_4bit(block, SD_BLOCK_SIZE);
+
+        pio_sm_put_blocking(pio, sm_tx, SD_DATA4_NIBBLES - 1);
+
+        sdio_dma_arm(dma_data_chan, 1);
+        dma_channel_configure(dma_data_chan, &cfg, pio_txf(pio, sm_tx), block,
+                              SD_BLOCK_SIZE / 4, true);
+        success = sdio_dma_wait(SDIO_READ_TIMEOUT_MS);
+
+        // CRC words go out MSB first as they are
+        pio_sm_put_blocking(pio, sm_tx, (uint32_t)(crc >> 32));
+        pio_sm_put_blocking(pio, sm_tx, (uint32_t)crc);
+
+        // CRC status token arrives after the card finishes programming
+        uint64_t start = time_us_64();
+        absolute_time_t timeout = make_timeout_time_ms(SDIO_BUSY_TIMEOUT_MS);
+        while (success && pio_sm_is_rx_fifo_empty(pio, sm_tx)) {
+            if (time_reached(timeout)) {
+                printf("[SD] Write busy timeout\n");
+                success = false;
+            } else {
+                sdio_wait_pause(start);
+            }
+        }
+        sdio_wait_record(SD_WAIT_WRITE, start);
+
+        if (success) {
+            uint32_t status = pio_sm_get(pio, sm_tx) & 0x0F;
+            if (status != SDIO_CRC_ACCEPTED) {
+                printf("[SD] Write rejected (status 0x%lx)\n", status);
+                card_info.write_errors++;
+                if (status == SDIO_CRC_REJECTED) {
+                    card_info.crc_errors++;
+                }
+                success = false;
+            }
+        }
+    }
+
+    if (!success) {
+        sdio_dma_abort(dma_data_chan);
+        sdio_restart_sm(pio, sm_tx, offset_tx);
+        pio_sm_set_consecutive_pindirs(pio, sm_tx, SD_SDIO_PIN_D0, 4, false);
+    }
+    pio_sm_set_enabled(pio, sm_tx, false);
+
+    return success;
+}
+
+/**
+ * @brief Byte address for standard capacity cards, block number for SDHC
+ */
+static inline uint32_t sdio_address(uint32_t block) {
+    return (card_info.type == SD_CARD_TYPE_SDHC) ? block : block * SD_BLOCK_SIZE;
+}
+
+/**
+ * @brief Initialize SD card
+ * @note The SPI instance and CS pin are not used: bus pins come from
+ *       SD_SDIO_PIN_* in config.h
+ */
+bool sd_card_init(spi_inst_t *spi, uint cs) {
+    (void)spi;
+    (void)cs;
+
+    memset(&card_info, 0, sizeof(card_info));
+    card_rca = 0;
+    stream_active = false;
+
+    printf("[SD] Initializing SD card (SDIO 4-bit)...\n");
+
+    sdio_hw_init();
+    sdio_set_clock(SDIO_CLK_INIT_HZ);
+
+    sdio_restart_sm(SDIO_PIO_CMD, sm_cmd, offset_cmd);
+    pio_sm_set_enabled(SDIO_PIO_DATA_TX, sm_clk, true);
+    pio_sm_set_enabled(SDIO_PIO_CMD, sm_cmd, true);
+
+    // At least 74 clocks before the first command
+    sleep_ms(1);
+
+    sdio_command(CMD0, 0, SD_RESP_NONE, NULL, NULL);
+
+    // Check voltage range (CMD8); v1 cards do not answer
+    uint32_t r7 = 0;
+    bool v2 = sdio_command(CMD8, 0x1AA, SD_RESP_R7, &r7, NULL) && (r7 & 0xFFF) == 0x1AA;
+
+    uint32_t ocr = 0;
+    int retry = 0;
+    do {
+        if (!sdio_app_command(ACMD41, SD_OCR_VOLTAGE_3V3 | (v2 ? SD_OCR_CCS : 0), SD_RESP_R3, &ocr)) {
+            ocr = 0;
+        }
+        if (ocr & SD_OCR_BUSY) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(SDIO_INIT_POLL_MS));
+    } while (++retry <= SDIO_INIT_TIMEOUT_MS / SDIO_INIT_POLL_MS);
+
+    if (!(ocr & SD_OCR_BUSY)) {
+        printf("[SD] ACMD41 timeout\n");
+        return false;
+    }
+
+    if (!v2) {
+        card_info.type = SD_CARD_TYPE_SD1;
+        printf("[SD] Card type: SD v1\n");
+    } else if (ocr & SD_OCR_CCS) {
+        card_info.type = SD_CARD_TYPE_SDHC;
+        printf("[SD] Card type: SDHC/SDXC\n");
+    } else {
+        card_info.type = SD_CARD_TYPE_SD2;
+        printf("[SD] Card type: SD v2\n");
+    }
+
+    // Identification: CID, relative address, CSD
+    uint32_t r6 = 0;
+    if (!sdio_command(CMD2, 0, SD_RESP_R2, NULL, card_info.cid) ||
+        !sdio_command(CMD3, 0, SD_RESP_R6, &r6, NULL)) {
+        printf("[SD] Card identification failed\n");
+        return false;
+    }
+    card_rca = r6 >> 16;
+
+    if (!sdio_command(CMD9, card_rca << 16, SD_RESP_R2, NULL, card_info.csd)) {
+        printf("[SD] Failed to read CSD\n");
+        return false;
+    }
+
+    card_info.sectors = sd_proto_csd_sectors(card_info.csd);
+    card_info.capacity_mb = (card_info.sectors / 2) / 1024;
+    printf("[SD] Capacity: %lu MB (%lu sectors)\n",
+           card_info.capacity_mb, card_info.sectors);
+
+    // Transfer state, 4-bit bus, 512-byte blocks
+    if (!sdio_command(CMD7, card_rca << 16, SD_RESP_R1B, NULL, NULL) ||
+        !sdio_app_command(ACMD6, 2, SD_RESP_R1, NULL)) {
+        printf("[SD] Failed to select 4-bit bus\n");
+        return false;
+    }
+
+    if (card_info.type != SD_CARD_TYPE_SDHC &&
+        !sdio_command(CMD16, SD_BLOCK_SIZE, SD_RESP_R1, NULL, NULL)) {
+        printf("[SD] Failed to set block size\n");
+        return false;
+    }
+
+    // Default Speed only: High Speed needs sys/4 or faster and a card
+    // output delay the sampling programs do not account for
+    sdio_set_clock(SDIO_CLK_DEFAULT_HZ);
+    card_info.clock_hz = clock_hz;
+    printf("[SD] SDIO 4-bit bus at %lu kHz\n", clock_hz / 1000);
+
+    card_info.initialized = true;
+    printf("[SD] Initialization complete\n");
+
+    return true;
+}
+
+/**
+ * @brief Close the open multi-block write, if any
+ */
+static bool sdio_stream_close(void) {
+    if (!stream_active) {
+        return true;
+    }
+
+    stream_active = false;
+    bool success = sdio_command(CMD12, 0, SD_RESP_R1B, NULL, NULL);
+    return sdio_wait_ready(SDIO_BUSY_TIMEOUT_MS, SD_WAIT_WRITE) && success;
+}
+
+/**
+ * @brief Start CMD25 at a block, pre-erasing the blocks known to follow
+ */
+static bool sdio_stream_open(uint32_t block, uint32_t pre_erase) {
+    if (!sdio_wait_ready(SDIO_BUSY_TIMEOUT_MS, SD_WAIT_WRITE)) {
+        return false;
+    }
+
+    // ACMD23 is only a hint; a card that rejects it still accepts CMD25
+    if (pre_erase > 1) {
+        sdio_app_command(ACMD23, pre_erase & 0x7FFFFF, SD_RESP_R1, NULL);
+    }
+
+    if (!sdio_command(CMD25, sdio_address(block), SD_RESP_R1, NULL, NULL)) {
+        return false;
+    }
+
+    stream_active = true;
+    stream_next_block = block;
+    return true;
+}
+
+/**
+ * @brief Deinitialize SD card
+ */
+void sd_card_deinit(void) {
+    if (card_info.initialized) {
+        sdio_stream_close();
+    }
+    card_info.initialized = false;
+    if (hw_ready) {
+        pio_sm_set_enabled(SDIO_PIO_CMD, sm_cmd, false);
+        pio_sm_set_enabled(SDIO_PIO_DATA_TX, sm_clk, false);
+    }
+}
+
+/**
+ * @brief Check that the card still answers (CMD13)
+ */
+bool sd_card_probe(void) {
+    if (!card_info.initialized) {
+        return false;
+    }
+
+    sdio_stream_close();
+
+    // A removed card never answers; a power-cycled one has lost its RCA
+    return sdio_command(CMD13, card_rca << 16, SD_RESP_R1, NULL, NULL);
+}
+
+/**
+ * @brief Finish outstanding writes and read back the card status
+ */
+bool sd_card_sync(void) {
+    if (!card_info.initialized) {
+        return false;
+    }
+
+    bool success = sdio_stream_close();
+    if (!write_unsynced) {
+        return success;
+    }
+    write_unsynced = false;
+
+    // Error bits of the status include those set while programming (ECC, CC, WP violation)
+    uint32_t status = 0;
+    if (!sdio_wait_ready(SDIO_BUSY_TIMEOUT_MS, SD_WAIT_WRITE) ||
+        !sdio_command(CMD13, card_rca << 16, SD_RESP_R1, &status, NULL)) {
+        printf("[SD] Sync status error (0x%08lx)\n", status);
+        card_info.write_errors++;
+        return false;
+    }
+    return success;
+}
+
+/**
+ * @brief Reset error counters and wait statistics
+ */
+void sd_card_reset_stats(void) {
+    card_info.crc_errors = 0;
+    card_info.read_retries = 0;
+    card_info.write_errors = 0;
+    memset(card_info.wait, 0, sizeof(card_info.wait));
+}
+
+/**
+ * @brief Check if SD card is initialized
+ */
+bool sd_card_is_initialized(void) {
+    return card_info.initialized;
+}
+
+/**
+ * @brief Get SD card information
+ */
+const sd_card_info_t* sd_card_get_info(void) {
+    return &card_info;
+}
+
+/**
+ * @brief Read blocks with one command, repeating it after CRC errors or timeouts
+ */
+static bool sdio_read_retry(uint8_t cmd, uint32_t block, uint32_t count, uint8_t *buffer) {
+    for (int attempt = 0; attempt <= SDIO_READ_RETRIES; attempt++) {
+        if (attempt > 0) {
+            card_info.read_retries++;
+        }
+        if (sdio_read_data(cmd, sdio_address(block), count, SD_BLOCK_SIZE, buffer)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Read multiple blocks
+ */
+bool sd_card_read_blocks(uint32_t block, uint32_t count, uint8_t *buffer) {
+    if (!card_info.initialized || !sdio_stream_close()) {
+        return false;
+    }
+
+    // DMA moves 32-bit words: unaligned buffers go through the bounce buffer
+    if ((uintptr_t)buffer & 3) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (!sdio_read_retry(CMD17, block + i, 1, bounce)) {
+                return false;
+            }
+            memcpy(buffer + i * SD_BLOCK_SIZE, bounce, SD_BLOCK_SIZE);
+        }
+        return true;
+    }
+
+    while (count > 0) {
+        uint32_t n = (count > SDIO_MAX_READ_BLOCKS) ? SDIO_MAX_READ_BLOCKS : count;
+        uint8_t cmd = (n == 1) ? CMD17 : CMD18;
+
+        if (!sdio_read_retry(cmd, block, n, buffer)) {
+            return false;
+        }
+
+        block += n;
+        count -= n;
+        buffer += n * SD_BLOCK_SIZE;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Write multiple blocks
+ * @note CMD24 for one block, otherwise one CMD25 with the count pre-erased (ACMD23)
+ */
+bool sd_card_write_blocks(uint32_t block, uint32_t count, const uint8_t *buffer) {
+    if (!card_info.initialized || !sdio_stream_close()) {
+        return false;
+    }
+
+    if (count > 1 || ((uintptr_t)buffer & 3)) {
+        bool success = sd_card_write_stream(block, count, buffer);
+        return sd_card_write_stream_end() && success;
+    }
+
+    if (!sdio_wait_ready(SDIO_BUSY_TIMEOUT_MS, SD_WAIT_WRITE) ||
+        !sdio_command(CMD24, sdio_address(block), SD_RESP_R1, NULL, NULL)) {
+        return false;
+    }
+
+    write_unsynced = true;
+    bool success = sdio_write_data(1, buffer);
+    return success && sdio_wait_ready(SDIO_BUSY_TIMEOUT_MS, SD_WAIT_WRITE);
+}
+
+/**
+ * @brief Write blocks within an open-ended multi-block write
+ */
+bool sd_card_write_stream(uint32_t block, uint32_t count, const uint8_t *buffer) {
+    if (!card_info.initialized) {
+        return false;
+    }
+
+    if (stream_active && block != stream_next_block) {
+        sdio_stream_close();
+    }
+    if (!stream_active && !sdio_stream_open(block, count)) {
+        return false;
+    }
+
+    write_unsynced = true;
+    bool success = true;
+    if ((uintptr_t)buffer & 3) {
+        // DMA moves 32-bit words: unaligned data goes through the bounce buffer
+        for (uint32_t i = 0; i < count && success; i++) {
+            memcpy(bounce, buffer + i * SD_BLOCK_SIZE, SD_BLOCK_SIZE);
+            success = sdio_write_data(1, bounce);
+        }
+    } else {
+        success = sdio_write_data(count, buffer);
+    }
+
+    if (!success) {
+        sdio_stream_close();
+        return false;
+    }
+
+    stream_next_block += count;
+    return true;
+}
+
+/**
+ * @brief Close the multi-block write session
+ */
+bool sd_card_write_stream_end(void) {
+    return sdio_stream_close();
+}
+
+/**
+ * @brief Read single block
+ */
+bool sd_card_read_block(uint32_t block, uint8_t *buffer) {
+    return sd_card_read_blocks(block, 1, buffer);
+}
+
+/**
+ * @brief Write single block
+ */
+bool sd_card_write_block(uint32_t block, const uint8_t *buffer) {
+    return sd_card_write_blocks(block, 1, buffer);
+}
+
+#endif // SD_BACKEND == SD_BACKEND_SDIO
@@ -28,5 +28,8 @@ void tasks_init_all(void) {
     // 7. USB - последней, так как зависит от floppy эмулятора
     usb_task_init();
     
+    // 8. Отладочная консоль (команды в задачу SDCARD)
+    console_task_init();
+    
     printf("=== All tasks initialized ===\n");
 }
@@ -16,6 +16,7 @@
 #include "tasks/floppy_emu_task.h"
 #include "tasks/usb_task.h"
 #include "tasks/led_task.h"
+#include "tasks/console_task.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -0,0 +1,182 @@
+#include "console_task.h"
+#include "sdcard_task.h"
+#include "floppy_emu_task.h"
+#include "config.h"
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>  // для strcasecmp
+
+// Команда консоли
+typedef struct {
+    const char *name;
+    const char *help;
+    void (*handler)(const char *args);
+} console_command_t;
+
+static void console_cmd_help(const char *args);
+
+/**
+ * @brief Тест скорости SD карты (выполняется в задаче SDCARD)
+ */
+static void console_cmd_bench(const char *args) {
+    (void)args;
+    
+    sdcard_message_t msg;
+    msg.command = SDCARD_CMD_BENCHMARK;
+    xQueueSend(sdcard_queue, &msg, portMAX_DELAY);
+}
+
+/**
+ * @brief Информация о SD карте и счетчики драйвера
+ */
+static void console_cmd_sdinfo(const char *args) {
+    (void)args;
+    sdcard_print_card_info();
+}
+
+/**
+ * @brief Создать чистый образ: mkimg <имя> <формат>
+ * 
+ * Формат - имя из floppy_formats (160K ... 1.44M), к имени без
+ * расширения добавляется .img (список образов показывает только их).
+ */
+static void console_cmd_mkimg(const char *args) {
+    char name[CONSOLE_LINE_MAX];  // Имя не длиннее строки команды
+    char format_name[8];
+    if (sscanf(args, "%s %7s", name, format_name) != 2) {
+        printf("Usage: mkimg <name> <format>, format:");
+        for (uint32_t i = 0; i < FLOPPY_FORMAT_COUNT; i++) {
+            printf(" %s", floppy_formats[i].name);
+        }
+        printf("\n");
+        return;
+    }
+    
+    const floppy_geometry_t *geometry = NULL;
+    for (uint32_t i = 0; i < FLOPPY_FORMAT_COUNT; i++) {
+        if (strcasecmp(format_name, floppy_formats[i].name) == 0) {
+            geometry = &floppy_formats[i];
+        }
+    }
+    if (geometry == NULL) {
+        printf("Unknown format: %s\n", format_name);
+        return;
+    }
+    
+    sdcard_message_t msg;
+    msg.command = SDCARD_CMD_CREATE_IMAGE;
+    msg.data.create.format = geometry->type;
+    
+    size_t len = strlen(name);
+    bool has_ext = (len > 4 && strcasecmp(name + len - 4, ".img") == 0);
+    int length = snprintf(msg.data.create.filename, sizeof(msg.data.create.filename),
+                          has_ext ? "%s" : "%s.img", name);
+    
+    // Вместе с '/' путь должен помещаться в IMAGE_PATH_MAX
+    if (length < 0 || (size_t)length + 1 >= sizeof(msg.data.create.filename)) {
+        printf("Name too long (max %d characters with extension)\n", IMAGE_PATH_MAX - 2);
+        return;
+    }
+    
+    xQueueSend(sdcard_queue, &msg, portMAX_DELAY);
+}
+
+static const console_command_t console_commands[] = {
+    { "help",   "List commands",                                 console_cmd_help },
+    { "bench",  "SD card speed/latency test (eject image first)", console_cmd_bench },
+    { "sdinfo", "SD card clock, error counters and wait times",   console_cmd_sdinfo },
+    { "mkimg",  "Create blank contiguous image: mkimg <name> <format>", console_cmd_mkimg },
+};
+
+#define CONSOLE_COMMAND_COUNT (sizeof(console_commands) / sizeof(console_commands[0]))
+
+/**
+ * @brief Список команд
+ */
+static void console_cmd_help(const char *args) {
+    (void)args;
+    
+    for (uint32_t i = 0; i < CONSOLE_COMMAND_COUNT; i++) {
+        printf("  %-8s %s\n", console_commands[i].name, console_commands[i].help);
+    }
+}
+
+/**
+ * @brief Выполнить строку команды: имя, затем аргументы через пробел
+ */
+static void console_execute(char *line) {
+    char *args = strchr(line, ' ');
+    if (args != NULL) {
+        *args++ = '\0';
+        while (*args == ' ') {
+            args++;
+        }
+    } else {
+        args = line + strlen(line);
+    }
+    
+    for (uint32_t i = 0; i < CONSOLE_COMMAND_COUNT; i++) {
+        if (strcmp(line, console_commands[i].name) == 0) {
+            console_commands[i].handler(args);
+            return;
+        }
+    }
+    
+    printf("Unknown command: %s (type 'help')\n", line);
+}
+
+/**
+ * @brief Основная задача консоли
+ */
+void console_task(void *pvParameters) {
+    (void)pvParameters;
+    
+    printf("[CONSOLE] Task started, type 'help'\n");
+    
+    char line[CONSOLE_LINE_MAX];
+    uint32_t length = 0;
+    
+    while (1) {
+        int c = getchar_timeout_us(0);
+        if (c == PICO_ERROR_TIMEOUT) {
+            vTaskDelay(pdMS_TO_TICKS(CONSOLE_POLL_MS));
+            continue;
+        }
+        
+        if (c == '\r' || c == '\n') {
+            if (length > 0) {
+                printf("\n");
+                line[length] = '\0';
+                console_execute(line);
+                length = 0;
+            }
+        } else if ((c == '\b' || c == 0x7F) && length > 0) {
+            length--;
+            printf("\b \b");
+        } else if (c >= ' ' && c < 0x7F && length < CONSOLE_LINE_MAX - 1) {
+            line[length++] = (char)c;
+            putchar(c);  // Эхо
+        }
+    }
+}
+
+/**
+ * @brief Инициализация задачи консоли
+ */
+void console_task_init(void) {
+    BaseType_t result = xTaskCreate(
+        console_task,
+        "CONSOLE",
+        STACK_SIZE_CONSOLE,
+        NULL,
+        TASK_PRIORITY_CONSOLE,
+        NULL
+    );
+    
+    if (result != pdPASS) {
+        printf("[CONSOLE] Failed to create task!\n");
+    } else {
+        printf("[CONSOLE] Task created successfully\n");
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef CONSOLE_TASK_H
+#define CONSOLE_TASK_H
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+// Отладочная консоль на UART (stdio): строка команды до Enter
+#define CONSOLE_LINE_MAX        80      // Максимальная длина строки команды
+#define CONSOLE_POLL_MS         20      // Период опроса UART
+
+// Функция создания задачи
+void console_task_init(void);
+
+// Функция задачи
+void console_task(void *pvParameters);
+
+#endif // CONSOLE_TASK_H
@@ -14,17 +14,61 @@ QueueHandle_t floppy_queue = NULL;
 // Блок кеша
 typedef struct {
     uint32_t start_sector;      // Начальный сектор блока
-    uint32_t timestamp;         // Время последнего доступа (1MHz counter)
-    bool valid;                 // Валидность блока
-    bool dirty;                 // Блок изменен (для записи)
-    uint8_t data[CACHE_BLOCK_SIZE];
+    int16_t prev;               // Предыдущий слот в LRU списке (ближе к MRU)
+    int16_t next;               // Следующий слот в LRU списке (ближе к LRU) / в списке свободных
+    uint8_t queue;              // Список, в котором находится блок (CACHE_QUEUE_*)
+    bool valid;                 // Слот занят блоком start_sector
+    bool prefetched;            // Загружен упреждающим чтением и еще не запрашивался
+    uint8_t valid_mask;         // Битовая маска секторов, содержащих актуальные данные
+    uint8_t dirty_mask;         // Битовая маска измененных секторов (для записи)
+    uint8_t refs;               // Ссылки на время обмена с картой: блок с ссылками не вытесняется
+    uint8_t filling;            // Секторы, которые сейчас читаются с карты без cache_mutex
+    uint8_t data[CACHE_BLOCK_SIZE] __attribute__((aligned(4)));  // Выровнено для DMA драйвера SD
 } cache_block_t;
 
-// Кеш FAT области (постоянный)
-static cache_block_t fat_cache[CACHE_FAT_BLOCKS];
+_Static_assert(CACHE_BLOCK_SECTORS <= 8, "valid_mask/dirty_mask hold one bit per sector");
 
-// Кеш данных (LRU замещение)
-static cache_block_t data_cache[CACHE_DATA_BLOCKS];
+// Общий пул блоков кеша: закрепленная служебная область образа (boot + FAT + root)
+// и данные (LRU или 2Q замещение, см. CACHE_POLICY). Размер служебной области
+// определяется по BPB образа, неиспользованные блоки достаются кешу данных.
+static cache_block_t cache_blocks[CACHE_TOTAL_BLOCKS];
+
+// Индекс кеша: номер блока образа -> слот в cache_blocks (или CACHE_NO_SLOT)
+static int16_t block_map[CACHE_MAP_BLOCKS];
+
+// Блоки образа с номером меньше pinned_blocks закреплены и не вытесняются
+static uint32_t pinned_blocks = 0;
+
+// Резидентный режим: закреплен весь образ, SD используется только для записи
+static bool cache_resident = false;
+
+// Интрузивный двусвязный список слотов: head = MRU, tail = кандидат на вытеснение
+typedef struct {
+    int16_t head;
+    int16_t tail;
+    uint16_t count;
+} cache_list_t;
+
+// Очереди замещения
+#define CACHE_QUEUE_AM      0   // Горячие блоки (LRU); в режиме LRU - единственный список
+#define CACHE_QUEUE_A1IN    1   // 2Q: блоки, запрошенные один раз (FIFO)
+#define CACHE_QUEUE_COUNT   2
+#define CACHE_QUEUE_PINNED  0xFF    // Закрепленный блок служебной области (вне списков)
+
+static cache_list_t cache_queues[CACHE_QUEUE_COUNT];
+
+// Размеры очередей 2Q от числа блоков данных: A1in ~25%, призрачная A1out ~50%
+static uint32_t a1in_limit = 0;
+static uint32_t ghost_limit = 0;
+
+// Призрачный список A1out: для каждого блока образа - номер вытеснения из A1in.
+// Блок считается "призраком", пока с момента его вытеснения прошло
+// меньше ghost_limit вытеснений из A1in (0 = не призрак)
+static uint16_t ghost_stamp[CACHE_MAP_BLOCKS];
+static uint16_t ghost_seq = 0;
+
+// Односвязный список свободных слотов (через поле next)
+static int16_t free_head = CACHE_NO_SLOT;
 
 // Информация о состоянии
 static floppy_info_t floppy_info = {
@@ -34,36 +78,60 @@ static floppy_info_t floppy_info = {
     .total_sectors = 0,
     .loaded_kb = 0,
     .total_fat_kb = 0,
+    .cache_policy = CACHE_POLICY,
     .cache_hits = 0,
-    .cache_misses = 0
+    .cache_misses = 0,
+    .cache_ghost_hits = 0,
+    .cache_evictions = 0
 };
 
 // Mutex для защиты кеша
 static SemaphoreHandle_t cache_mutex = NULL;
 
-/**
- * @brief Получить текущее время в микросекундах
- */
-static inline uint32_t get_timestamp(void) {
-    return time_us_32();
-}
+// Запись на карту идет без cache_mutex; барьер (cache_sync) ждет ее завершения.
+// Берется только без cache_mutex
+static SemaphoreHandle_t writeback_mutex = NULL;
+
+// Детектор последовательного чтения (защищен cache_mutex)
+static uint32_t stream_last_block = UINT32_MAX;  // Последний прочитанный блок
+static uint32_t stream_run = 0;                  // Длина текущей возрастающей серии блоков
+static uint32_t stream_prefetched_to = 0;        // Блоки до этого номера уже запрошены
+static uint32_t stream_id = 0;                   // Номер потока (меняется при разрыве серии)
+
+// Асинхронное дочитывание блока для USB (защищено cache_mutex).
+// Один запрос в задаче SDCARD: USB обслуживает хост последовательно
+typedef struct {
+    sdcard_io_request_t req;    // Запрос чтения в данные блока
+    cache_block_t *block;       // Блок, захваченный на время чтения (refs)
+    uint32_t block_no;          // Номер блока образа
+    uint8_t mask;               // Секторы блока, которые читаются
+    bool active;                // Запрос отправлен и результат еще не принят
+} cache_fill_t;
+
+static cache_fill_t cache_fill = { .active = false };
+
+// Буфер упреждающего чтения (только задача FLOPPY)
+static uint8_t prefetch_buffer[CACHE_BLOCK_SIZE] __attribute__((aligned(4)));
+
+// Состояние фоновой записи (защищено cache_mutex)
+static TickType_t last_io_tick = 0;              // Последнее обращение хоста
+static TickType_t first_dirty_tick = 0;          // Когда появился самый старый грязный блок
+static bool sync_pending = false;                // Данные записаны на карту, барьер (sdcard_sync) еще не выполнен
+static volatile bool flush_queued = false;       // FLOPPY_CMD_FLUSH после WRITE10 уже в очереди
+static uint32_t dirty_data_blocks = 0;           // Грязные блоки вне закрепленной служебной области
+static uint32_t writeback_failures = 0;          // Блоков, не записанных на карту (для floppy_flush)
 
 /**
  * @brief Определить тип диска по размеру файла
  */
 static floppy_type_t detect_floppy_type(uint32_t file_size) {
-    // Размеры в байтах
-    const uint32_t size_720k = 720 * 1024;    // 737280 bytes
-    const uint32_t size_1200k = 1200 * 1024;  // 1228800 bytes
-    const uint32_t size_1440k = 1440 * 1024;  // 1474560 bytes
-    
-    // Допуск ±512 байт
-    if (file_size >= (size_720k - 512) && file_size <= (size_720k + 512)) {
-        return FLOPPY_TYPE_720K;
-    } else if (file_size >= (size_1200k - 512) && file_size <= (size_1200k + 512)) {
-        return FLOPPY_TYPE_1200K;
-    } else if (file_size >= (size_1440k - 512) && file_size <= (size_1440k + 512)) {
-        return FLOPPY_TYPE_1440K;
+    for (size_t i = 0; i < FLOPPY_FORMAT_COUNT; i++) {
+        uint32_t size = floppy_formats[i].sectors * FLOPPY_SECTOR_SIZE;
+        
+        // Допуск ±512 байт
+        if (file_size >= (size - 512) && file_size <= (size + 512)) {
+            return floppy_formats[i].type;
+        }
     }
     
     printf("[FLOPPY] Unknown disk size: %lu bytes\n", file_size);
@@ -74,7 +142,7 @@ static floppy_type_t detect_floppy_type(uint32_t file_size) {
  * @brief Получить геометрию диска по типу
  */
 static const floppy_geometry_t* get_floppy_geometry(floppy_type_t type) {
-    for (int i = 0; i < 3; i++) {
+    for (size_t i = 0; i < FLOPPY_FORMAT_COUNT; i++) {
         if (floppy_formats[i].type == type) {
             return &floppy_formats[i];
         }
@@ -82,238 +150,1195 @@ static const floppy_geometry_t* get_floppy_geometry(floppy_type_t type) {
     return NULL;
 }
 
+/**
+ * @brief Разобрать BPB загрузочного сектора FAT12
+ * @param boot Сектор 0 образа
+ * @param image_sectors Количество секторов в файле образа
+ * @param total_sectors [out] Количество секторов диска по BPB
+ * @param meta_sectors [out] Служебная область: reserved + FATs + root directory
+ * @return true если BPB корректен и согласован с размером образа
+ */
+static bool floppy_parse_bpb(const uint8_t *boot, uint32_t image_sectors,
+                             uint32_t *total_sectors, uint32_t *meta_sectors) {
+    uint16_t bytes_per_sector = boot[11] | (boot[12] << 8);
+    uint8_t  sectors_per_cluster = boot[13];
+    uint16_t reserved = boot[14] | (boot[15] << 8);
+    uint8_t  num_fats = boot[16];
+    uint16_t root_entries = boot[17] | (boot[18] << 8);
+    uint32_t total = boot[19] | (boot[20] << 8);
+    uint16_t fat_size = boot[22] | (boot[23] << 8);
+    
+    if (total == 0) {
+        total = (uint32_t)boot[32] | ((uint32_t)boot[33] << 8) |
+                ((uint32_t)boot[34] << 16) | ((uint32_t)boot[35] << 24);
+    }
+    
+    if (bytes_per_sector != FLOPPY_SECTOR_SIZE || sectors_per_cluster == 0 ||
+        reserved == 0 || num_fats == 0 || num_fats > 2 || fat_size == 0 ||
+        root_entries == 0 || (root_entries % 16) != 0) {
+        return false;
+    }
+    
+    uint32_t root_sectors = (root_entries * 32 + FLOPPY_SECTOR_SIZE - 1) / FLOPPY_SECTOR_SIZE;
+    uint32_t meta = reserved + num_fats * fat_size + root_sectors;
+    
+    if (total == 0 || total > image_sectors || total > FLOPPY_SECTORS || meta >= total) {
+        return false;
+    }
+    
+    *total_sectors = total;
+    *meta_sectors = meta;
+    return true;
+}
+
+/**
+ * @brief Подождать тик без cache_mutex: дать завершиться обмену с картой,
+ *        который держит блок
+ * @note Вызывается под cache_mutex; после возврата состояние кеша нужно
+ *       проверить заново
+ */
+static void cache_wait_unlocked(void) {
+    xSemaphoreGive(cache_mutex);
+    vTaskDelay(1);
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+}
+
+/**
+ * @brief Есть ли блоки, захваченные обменом с картой (refs)
+ */
+static bool cache_blocks_claimed(void) {
+    for (int i = 0; i < CACHE_TOTAL_BLOCKS; i++) {
+        if (cache_blocks[i].refs > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * @brief Инициализация кеша
+ * @note Вызывается под cache_mutex (при старте - до запуска планировщика)
  */
 static void cache_init(void) {
     printf("[FLOPPY] Initializing cache...\n");
     
-    // Очистка FAT кеша
-    for (int i = 0; i < CACHE_FAT_BLOCKS; i++) {
-        fat_cache[i].start_sector = 0;
-        fat_cache[i].timestamp = 0;
-        fat_cache[i].valid = false;
-        fat_cache[i].dirty = false;
+    // Дождаться незавершенного дочитывания: задача SDCARD пишет в данные блока
+    while (cache_fill.active && cache_fill.req.state == SDCARD_IO_PENDING) {
+        cache_wait_unlocked();
+    }
+    if (cache_fill.active) {
+        // Результат так и не принят (хост не повторил запрос) - снять захват
+        cache_fill.active = false;
+        if (cache_fill.block->refs > 0) {
+            cache_fill.block->refs--;
+        }
+    }
+    
+    // Дождаться обменов с картой без mutex (синхронное дочитывание, запись
+    // серии): они держат ссылки на блоки и обращаются к ним после обмена
+    while (cache_blocks_claimed()) {
+        cache_wait_unlocked();
+    }
+    
+    // Очистка пула: все слоты в списке свободных
+    for (int i = 0; i < CACHE_TOTAL_BLOCKS; i++) {
+        cache_blocks[i].start_sector = 0;
+        cache_blocks[i].prev = CACHE_NO_SLOT;
+        cache_blocks[i].next = (i + 1 < CACHE_TOTAL_BLOCKS) ? (int16_t)(i + 1) : CACHE_NO_SLOT;
+        cache_blocks[i].valid = false;
+        cache_blocks[i].valid_mask = 0;
+        cache_blocks[i].dirty_mask = 0;
+        cache_blocks[i].refs = 0;
+        cache_blocks[i].filling = 0;
+    }
+    free_head = 0;
+    for (int q = 0; q < CACHE_QUEUE_COUNT; q++) {
+        cache_queues[q].head = CACHE_NO_SLOT;
+        cache_queues[q].tail = CACHE_NO_SLOT;
+        cache_queues[q].count = 0;
     }
     
-    // Очистка кеша данных
-    for (int i = 0; i < CACHE_DATA_BLOCKS; i++) {
-        data_cache[i].start_sector = 0;
-        data_cache[i].timestamp = 0;
-        data_cache[i].valid = false;
-        data_cache[i].dirty = false;
+    // Очистка индекса и призрачного списка
+    for (int i = 0; i < CACHE_MAP_BLOCKS; i++) {
+        block_map[i] = CACHE_NO_SLOT;
+        ghost_stamp[i] = 0;
     }
+    ghost_seq = 0;
     
+    // Служебная область задается после разбора BPB (cache_set_pinned)
+    pinned_blocks = 0;
+    cache_resident = false;
+    floppy_info.resident = false;
+    a1in_limit = CACHE_TOTAL_BLOCKS / 4;
+    ghost_limit = CACHE_TOTAL_BLOCKS / 2;
+    
+    floppy_info.cache_policy = CACHE_POLICY;
     floppy_info.cache_hits = 0;
     floppy_info.cache_misses = 0;
+    floppy_info.cache_ghost_hits = 0;
+    floppy_info.cache_evictions = 0;
+    floppy_info.readahead_blocks = 0;
+    floppy_info.readahead_hits = 0;
+    floppy_info.dirty_blocks = 0;
+    dirty_data_blocks = 0;
+    floppy_info.flushed_sectors = 0;
+    floppy_info.write_allocs = 0;
+    floppy_info.partial_fills = 0;
+    floppy_info.syncs = 0;
+    floppy_info.sync_errors = 0;
+    sync_pending = false;
+    
+    stream_last_block = UINT32_MAX;
+    stream_run = 0;
+    stream_prefetched_to = 0;
+    stream_id++;
     
     printf("[FLOPPY] Cache initialized:\n");
-    printf("[FLOPPY]   Total: %d KB\n", CACHE_TOTAL_SIZE / 1024);
-    printf("[FLOPPY]   FAT blocks: %d (%d KB)\n", CACHE_FAT_BLOCKS, (CACHE_FAT_BLOCKS * CACHE_BLOCK_SIZE) / 1024);
-    printf("[FLOPPY]   Data blocks: %d (%d KB)\n", CACHE_DATA_BLOCKS, (CACHE_DATA_BLOCKS * CACHE_BLOCK_SIZE) / 1024);
+    printf("[FLOPPY]   Total: %d KB (%d blocks)\n", CACHE_TOTAL_SIZE / 1024, CACHE_TOTAL_BLOCKS);
 }
 
 /**
- * @brief Найти блок в кеше
- * @param sector Номер сектора
- * @param is_fat true если это FAT область
+ * @brief Закрепить служебную область образа, остальные блоки отдать кешу данных
+ * @param meta_sectors Размер служебной области в секторах (boot + FATs + root)
+ * @param total_sectors Размер образа; образ, помещающийся в кеш, закрепляется целиком
+ */
+static void cache_set_pinned(uint32_t meta_sectors, uint32_t total_sectors) {
+    uint32_t image_blocks = (total_sectors + CACHE_BLOCK_SECTORS - 1) / CACHE_BLOCK_SECTORS;
+    
+    if (CACHE_RESIDENT_MODE && image_blocks <= CACHE_TOTAL_BLOCKS) {
+        cache_resident = true;
+        floppy_info.resident = true;
+        pinned_blocks = image_blocks;
+        floppy_info.pinned_blocks = pinned_blocks;
+        printf("[FLOPPY]   Resident mode: whole image (%lu blocks) in RAM\n", image_blocks);
+        return;
+    }
+    
+    pinned_blocks = (meta_sectors + CACHE_BLOCK_SECTORS - 1) / CACHE_BLOCK_SECTORS;
+    if (pinned_blocks > CACHE_MAX_PINNED_BLOCKS) {
+        pinned_blocks = CACHE_MAX_PINNED_BLOCKS;  // Остаток служебной области кешируется как данные
+    }
+    
+    uint32_t data_blocks = CACHE_TOTAL_BLOCKS - pinned_blocks;
+    a1in_limit = data_blocks / 4;
+    ghost_limit = data_blocks / 2;
+    floppy_info.pinned_blocks = pinned_blocks;
+    
+    printf("[FLOPPY]   Pinned blocks: %lu (%lu KB, %lu metadata sectors)\n",
+           pinned_blocks, (pinned_blocks * CACHE_BLOCK_SIZE) / 1024, meta_sectors);
+    printf("[FLOPPY]   Data blocks: %lu (%lu KB)\n",
+           data_blocks, (data_blocks * CACHE_BLOCK_SIZE) / 1024);
+}
+
+/**
+ * @brief Исключить слот из его списка
+ */
+static void list_unlink(int16_t slot) {
+    cache_block_t *block = &cache_blocks[slot];
+    cache_list_t *list = &cache_queues[block->queue];
+    
+    if (block->prev != CACHE_NO_SLOT) {
+        cache_blocks[block->prev].next = block->next;
+    } else {
+        list->head = block->next;
+    }
+    
+    if (block->next != CACHE_NO_SLOT) {
+        cache_blocks[block->next].prev = block->prev;
+    } else {
+        list->tail = block->prev;
+    }
+    
+    block->prev = CACHE_NO_SLOT;
+    block->next = CACHE_NO_SLOT;
+    list->count--;
+}
+
+/**
+ * @brief Поставить слот в голову списка (MRU)
+ */
+static void list_push_head(uint8_t queue, int16_t slot) {
+    cache_block_t *block = &cache_blocks[slot];
+    cache_list_t *list = &cache_queues[queue];
+    
+    block->queue = queue;
+    block->prev = CACHE_NO_SLOT;
+    block->next = list->head;
+    
+    if (list->head != CACHE_NO_SLOT) {
+        cache_blocks[list->head].prev = slot;
+    } else {
+        list->tail = slot;
+    }
+    list->head = slot;
+    list->count++;
+}
+
+/**
+ * @brief Проверить, есть ли блок в призрачном списке A1out
+ */
+static bool ghost_contains(uint32_t block_no) {
+    uint16_t stamp = ghost_stamp[block_no];
+    return stamp != 0 && (uint16_t)(ghost_seq - stamp) < ghost_limit;
+}
+
+/**
+ * @brief Запомнить вытесненный из A1in блок в призрачном списке A1out
+ */
+static void ghost_add(uint32_t block_no) {
+    ghost_seq++;
+    if (ghost_seq == 0) {
+        ghost_seq = 1;  // 0 зарезервирован под "не призрак"
+    }
+    ghost_stamp[block_no] = ghost_seq;
+}
+
+/**
+ * @brief Пометить секторы блока грязными
+ */
+static void cache_mark_dirty(cache_block_t *block, uint8_t mask) {
+    if (block->dirty_mask == 0) {
+        if (floppy_info.dirty_blocks++ == 0) {
+            first_dirty_tick = xTaskGetTickCount();
+        }
+        if (block->start_sector / CACHE_BLOCK_SECTORS >= pinned_blocks) {
+            dirty_data_blocks++;
+        }
+    }
+    block->dirty_mask |= mask;
+}
+
+/**
+ * @brief Пометить блок чистым после записи на SD карту
+ */
+static void cache_mark_clean(cache_block_t *block) {
+    if (block->dirty_mask != 0) {
+        block->dirty_mask = 0;
+        floppy_info.dirty_blocks--;
+        if (block->start_sector / CACHE_BLOCK_SECTORS >= pinned_blocks) {
+            dirty_data_blocks--;
+        }
+    }
+}
+
+/**
+ * @brief Записать только измененные секторы блока
+ * @param block Блок кеша
+ * @param mask Секторы для записи (снимок dirty_mask)
+ * @return true при успехе
+ * @note Серия, продолжающая предыдущую, пишется задачей SDCARD без
+ *       перепозиционирования - одной многоблочной записью на карту
+ */
+static bool cache_write_dirty_sectors(const cache_block_t *block, uint8_t mask) {
+    uint32_t i = 0;
+    
+    while (i < CACHE_BLOCK_SECTORS) {
+        if (!(mask & (1u << i))) {
+            i++;
+            continue;
+        }
+        
+        // Непрерывная серия грязных секторов внутри блока
+        uint32_t run = 1;
+        while (i + run < CACHE_BLOCK_SECTORS && (mask & (1u << (i + run)))) {
+            run++;
+        }
+        
+        if (!sdcard_write_sectors(block->start_sector + i, run, &block->data[i * FLOPPY_SECTOR_SIZE])) {
+            return false;
+        }
+        
+        floppy_info.flushed_sectors += run;
+        i += run;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Получить блок из кеша без изменения порядка замещения
+ */
+static cache_block_t* cache_peek_block(uint32_t block_no) {
+    int16_t slot = block_map[block_no];
+    return (slot != CACHE_NO_SLOT) ? &cache_blocks[slot] : NULL;
+}
+
+/**
+ * @brief Найти блок в кеше за O(1)
+ * @param block_no Номер блока образа (sector / CACHE_BLOCK_SECTORS)
  * @return Указатель на блок или NULL
  */
-static cache_block_t* cache_find_block(uint32_t sector, bool is_fat) {
-    uint32_t block_start = (sector / CACHE_BLOCK_SECTORS) * CACHE_BLOCK_SECTORS;
+static cache_block_t* cache_find_block(uint32_t block_no) {
+    int16_t slot = block_map[block_no];
+    if (slot == CACHE_NO_SLOT) {
+        return NULL;
+    }
+    
+    // Попадание в горячий список - переместить в голову (LRU).
+    // A1in - FIFO: повторное обращение не продвигает блок, иначе
+    // последовательное чтение файла вытеснило бы горячие блоки.
+    cache_block_t *block = &cache_blocks[slot];
+    if (block->queue == CACHE_QUEUE_AM && slot != cache_queues[CACHE_QUEUE_AM].head) {
+        list_unlink(slot);
+        list_push_head(CACHE_QUEUE_AM, slot);
+    }
+    
+    return block;
+}
+
+/**
+ * @brief Выбрать жертву для вытеснения согласно политике замещения
+ * @param clean_only Рассматривать только чистые блоки (запись на карту не удалась)
+ */
+static int16_t cache_select_victim(bool clean_only) {
+    const cache_list_t *am = &cache_queues[CACHE_QUEUE_AM];
+    const cache_list_t *a1in = &cache_queues[CACHE_QUEUE_A1IN];
     
-    if (is_fat) {
-        // Поиск в FAT кеше
-        for (int i = 0; i < CACHE_FAT_BLOCKS; i++) {
-            if (fat_cache[i].valid && fat_cache[i].start_sector == block_start) {
-                fat_cache[i].timestamp = get_timestamp();
-                return &fat_cache[i];
+    uint8_t first = CACHE_QUEUE_AM;
+    if (CACHE_POLICY == CACHE_POLICY_2Q &&
+        (a1in->count > a1in_limit || am->count == 0)) {
+        first = CACHE_QUEUE_A1IN;
+    }
+    
+    // Самый старый блок очереди, не захваченный обменом с картой (refs == 0);
+    // если вся очередь захвачена - берем из другой
+    for (int q = 0; q < CACHE_QUEUE_COUNT; q++) {
+        uint8_t queue = (q == 0) ? first : (uint8_t)(first ^ 1);
+        for (int16_t slot = cache_queues[queue].tail; slot != CACHE_NO_SLOT; slot = cache_blocks[slot].prev) {
+            if (cache_blocks[slot].refs == 0 &&
+                (!clean_only || cache_blocks[slot].dirty_mask == 0)) {
+                return slot;
             }
         }
+    }
+    
+    return CACHE_NO_SLOT;
+}
+
+/**
+ * @brief Записать серию соседних грязных блоков одной операцией записи
+ * @param first_block Первый блок серии (должен быть грязным)
+ * @param blocks [out] Длина серии
+ * @return true, если записана вся серия
+ * @note Вызывается под cache_mutex; на время записи mutex отпускается,
+ *       после возврата состояние кеша нужно проверить заново
+ */
+static bool cache_flush_run(uint32_t first_block, uint32_t *blocks) {
+    uint32_t total_blocks = (floppy_info.total_sectors + CACHE_BLOCK_SECTORS - 1) / CACHE_BLOCK_SECTORS;
+    cache_block_t *run[CACHE_FLUSH_MAX_RUN];
+    uint8_t masks[CACHE_FLUSH_MAX_RUN];
+    uint32_t count = 0;
+    
+    // Блоки серии захватываются (refs) и помечаются чистыми до записи:
+    // секторы, измененные хостом во время записи, снова станут грязными
+    while (count < CACHE_FLUSH_MAX_RUN && first_block + count < total_blocks) {
+        cache_block_t *block = cache_peek_block(first_block + count);
+        if (block == NULL || block->dirty_mask == 0) {
+            break;
+        }
+        run[count] = block;
+        masks[count] = block->dirty_mask;
+        block->refs++;
+        cache_mark_clean(block);
+        count++;
+    }
+    *blocks = count;
+    if (count == 0) {
+        return true;
+    }
+    
+    // Запись без cache_mutex: попадания USB не ждут карту.
+    // Соседние блоки лежат в разных слотах, но смежные грязные секторы
+    // пишутся подряд одной многоблочной записью; барьер - в cache_sync()
+    xSemaphoreGive(cache_mutex);
+    xSemaphoreTake(writeback_mutex, portMAX_DELAY);
+    
+    uint32_t written = 0;
+    while (written < count && cache_write_dirty_sectors(run[written], masks[written])) {
+        written++;
+    }
+    
+    xSemaphoreGive(writeback_mutex);
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    
+    // Незаписанные секторы снова грязные
+    for (uint32_t i = 0; i < count; i++) {
+        if (run[i]->refs > 0) {
+            run[i]->refs--;
+        }
+        if (i >= written) {
+            cache_mark_dirty(run[i], masks[i]);
+        }
+    }
+    if (written > 0) {
+        sync_pending = true;
+    }
+    writeback_failures += count - written;
+    
+    return written == count;
+}
+
+/**
+ * @brief Подготовить место под новый блок: грязную жертву вытеснения
+ *        записать заранее, без cache_mutex
+ * @return true, если mutex отпускался (блок мог загрузить другой поток)
+ * @note Вызывается под cache_mutex
+ */
+static bool cache_reclaim(void) {
+    if (free_head != CACHE_NO_SLOT) {
+        return false;
+    }
+    
+    int16_t slot = cache_select_victim(false);
+    if (slot == CACHE_NO_SLOT || cache_blocks[slot].dirty_mask == 0) {
+        return false;
+    }
+    
+    cache_block_t *victim = &cache_blocks[slot];
+    printf("[FLOPPY] Writing back dirty block at sector %lu (mask 0x%02X)\n",
+           victim->start_sector, victim->dirty_mask);
+    
+    uint32_t blocks;
+    if (!cache_flush_run(victim->start_sector / CACHE_BLOCK_SECTORS, &blocks)) {
+        printf("[FLOPPY] Write back failed, block kept dirty\n");
+    }
+    return true;
+}
+
+/**
+ * @brief Получить слот под блок: свободный или вытесненный по политике замещения
+ * @param block_no Номер блока образа
+ * @return Указатель на блок (уже в индексе и в одной из очередей)
+ */
+static cache_block_t* cache_get_free_block(uint32_t block_no) {
+    int16_t slot = free_head;
+    if (slot != CACHE_NO_SLOT) {
+        // Свободный слот
+        free_head = cache_blocks[slot].next;
+        cache_blocks[slot].next = CACHE_NO_SLOT;
     } else {
-        // Поиск в кеше данных
-        for (int i = 0; i < CACHE_DATA_BLOCKS; i++) {
-            if (data_cache[i].valid && data_cache[i].start_sector == block_start) {
-                data_cache[i].timestamp = get_timestamp();
-                return &data_cache[i];
+        slot = cache_select_victim(false);
+        if (slot == CACHE_NO_SLOT) {
+            return NULL;  // Все блоки закреплены или захвачены
+        }
+        
+        // Грязную жертву заранее записывает cache_reclaim(). Если запись
+        // не удалась (например карта извлечена) или хост снова изменил блок,
+        // данные остаются в кеше, а вытесняется самый старый чистый блок
+        if (cache_blocks[slot].dirty_mask != 0) {
+            slot = cache_select_victim(true);
+            if (slot == CACHE_NO_SLOT) {
+                return NULL;
             }
         }
+        
+        cache_block_t *victim = &cache_blocks[slot];
+        uint32_t victim_no = victim->start_sector / CACHE_BLOCK_SECTORS;
+        
+        if (victim->queue == CACHE_QUEUE_A1IN) {
+            ghost_add(victim_no);
+        }
+        
+        list_unlink(slot);
+        block_map[victim_no] = CACHE_NO_SLOT;
+        victim->valid = false;
+        floppy_info.cache_evictions++;
     }
     
-    return NULL;
+    block_map[block_no] = slot;
+    
+    // Служебная область закреплена: вне очередей, никогда не вытесняется
+    if (block_no < pinned_blocks) {
+        cache_blocks[slot].queue = CACHE_QUEUE_PINNED;
+        return &cache_blocks[slot];
+    }
+    
+    // Блок из A1out уже запрашивался недавно - сразу в горячий список
+    uint8_t queue = CACHE_QUEUE_AM;
+    if (CACHE_POLICY == CACHE_POLICY_2Q) {
+        if (ghost_contains(block_no)) {
+            ghost_stamp[block_no] = 0;
+            floppy_info.cache_ghost_hits++;
+        } else {
+            queue = CACHE_QUEUE_A1IN;
+        }
+    }
+    
+    list_push_head(queue, slot);
+    
+    return &cache_blocks[slot];
 }
 
 /**
- * @brief Найти свободный или самый старый блок для замещения
- * @param is_fat true если это FAT область
- * @return Указатель на блок
+ * @brief Освободить слот кеша (например после ошибки чтения)
  */
-static cache_block_t* cache_get_free_block(bool is_fat) {
-    if (is_fat) {
-        // FAT кеш - ищем свободный или самый старый
-        cache_block_t* oldest = &fat_cache[0];
-        for (int i = 0; i < CACHE_FAT_BLOCKS; i++) {
-            if (!fat_cache[i].valid) {
-                return &fat_cache[i];
-            }
-            if (fat_cache[i].timestamp < oldest->timestamp) {
-                oldest = &fat_cache[i];
-            }
+static void cache_release_block(cache_block_t *block, uint32_t block_no) {
+    int16_t slot = (int16_t)(block - cache_blocks);
+    if (block->queue != CACHE_QUEUE_PINNED) {
+        list_unlink(slot);
+    }
+    block_map[block_no] = CACHE_NO_SLOT;
+    block->valid = false;
+    block->valid_mask = 0;
+    cache_mark_clean(block);
+    block->next = free_head;
+    free_head = slot;
+}
+
+/**
+ * @brief Дочитать с SD карты секторы блока, которых еще нет в кеше
+ * @note Вызывается под cache_mutex. На время чтения mutex отпускается:
+ *       блок захвачен (refs), читаемые секторы отмечены в filling, и запись
+ *       хоста в них ждет конца чтения. Измененные хостом секторы не перезаписываются
+ */
+static bool cache_fill_block(cache_block_t *block) {
+    // Не выходим за пределы образа
+    uint32_t end = (block->start_sector < floppy_info.total_sectors) ?
+                   floppy_info.total_sectors - block->start_sector : 0;
+    if (end > CACHE_BLOCK_SECTORS) {
+        end = CACHE_BLOCK_SECTORS;
+    }
+    
+    bool ok = true;
+    block->refs++;
+    
+    uint32_t i = 0;
+    while (i < end) {
+        if (block->valid_mask & (1u << i)) {
+            i++;
+            continue;
         }
-        return oldest;
-    } else {
-        // Кеш данных - LRU
-        cache_block_t* oldest = &data_cache[0];
-        for (int i = 0; i < CACHE_DATA_BLOCKS; i++) {
-            if (!data_cache[i].valid) {
-                return &data_cache[i];
-            }
-            if (data_cache[i].timestamp < oldest->timestamp) {
-                oldest = &data_cache[i];
-            }
+        if (block->filling & (1u << i)) {
+            // Сектор дочитывает другой поток - дождаться и проверить заново
+            cache_wait_unlocked();
+            continue;
         }
         
-        // Если блок грязный, нужно записать его обратно
-        if (oldest->dirty) {
-            printf("[FLOPPY] Writing back dirty block at sector %lu\n", oldest->start_sector);
-            for (uint32_t i = 0; i < CACHE_BLOCK_SECTORS; i++) {
-                sdcard_write_sector(oldest->start_sector + i, 
-                                   &oldest->data[i * FLOPPY_SECTOR_SIZE]);
-            }
-            oldest->dirty = false;
+        // Непрерывная серия недостающих секторов - одно многосекторное чтение
+        uint32_t run = 1;
+        while (i + run < end && !((block->valid_mask | block->filling) & (1u << (i + run)))) {
+            run++;
         }
+        uint8_t mask = (uint8_t)(((1u << run) - 1) << i);
+        uint32_t sector = block->start_sector + i;
         
-        return oldest;
+        block->filling |= mask;
+        xSemaphoreGive(cache_mutex);
+        ok = sdcard_read_sectors(sector, run, &block->data[i * FLOPPY_SECTOR_SIZE]);
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+        block->filling &= (uint8_t)~mask;
+        
+        if (!ok) {
+            printf("[FLOPPY] Failed to read sectors %lu+%lu\n", sector, run);
+            break;
+        }
+        block->valid_mask |= mask;
+        i += run;
     }
+    
+    block->refs--;
+    return ok;
+}
+
+/**
+ * @brief Предзагрузить блок целиком одним многосекторным чтением
+ * @note Используется при загрузке образа для закрепленных блоков
+ */
+static bool cache_preload_block(uint32_t block_no) {
+    uint32_t block_start = block_no * CACHE_BLOCK_SECTORS;
+    
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    
+    cache_block_t *block = cache_get_free_block(block_no);
+    if (block == NULL) {
+        xSemaphoreGive(cache_mutex);
+        return false;
+    }
+    block->start_sector = block_start;
+    block->valid = true;
+    block->valid_mask = 0;
+    block->prefetched = false;
+    
+    bool ok = cache_fill_block(block);
+    if (!ok) {
+        cache_release_block(block, block_no);
+    }
+    
+    xSemaphoreGive(cache_mutex);
+    return ok;
 }
 
 /**
  * @brief Загрузить блок с SD карты в кеш
- * @param sector Номер сектора
- * @param is_fat true если это FAT область
+ * @param block_no Номер блока образа
+ * @param fill false - только выделить блок (промах записи, секторы дочитываются по требованию)
  * @return Указатель на блок или NULL при ошибке
  */
-static cache_block_t* cache_load_block(uint32_t sector, bool is_fat) {
-    uint32_t block_start = (sector / CACHE_BLOCK_SECTORS) * CACHE_BLOCK_SECTORS;
-    cache_block_t* block = cache_get_free_block(is_fat);
+static cache_block_t* cache_load_block(uint32_t block_no, bool fill) {
+    uint32_t block_start = block_no * CACHE_BLOCK_SECTORS;
+    cache_block_t* block = cache_get_free_block(block_no);
     
     if (block == NULL) {
         printf("[FLOPPY] Failed to get cache block\n");
         return NULL;
     }
     
-    printf("[FLOPPY] Loading block starting at sector %lu\n", block_start);
+    block->start_sector = block_start;
+    block->valid = true;
+    block->valid_mask = 0;
+    block->prefetched = false;
     
-    // Чтение блока с SD карты (упреждающее чтение)
-    for (uint32_t i = 0; i < CACHE_BLOCK_SECTORS; i++) {
-        if (block_start + i >= FLOPPY_SECTORS) {
-            break;  // Не выходим за пределы образа
-        }
+    if (fill) {
+        printf("[FLOPPY] Loading block starting at sector %lu\n", block_start);
         
-        if (!sdcard_read_sector(block_start + i, &block->data[i * FLOPPY_SECTOR_SIZE])) {
-            printf("[FLOPPY] Failed to read sector %lu\n", block_start + i);
+        // Чтение блока с SD карты (упреждающее чтение)
+        if (!cache_fill_block(block)) {
+            // Пока mutex был отпущен, блок мог понадобиться другому потоку
+            if (block->refs == 0 && block->valid_mask == 0 && block->dirty_mask == 0) {
+                cache_release_block(block, block_no);
+            }
             return NULL;
         }
     }
     
-    block->start_sector = block_start;
-    block->timestamp = get_timestamp();
-    block->valid = true;
-    block->dirty = false;
+    return block;
+}
+
+/**
+ * @brief Найти блок в кеше или загрузить его с SD карты
+ * @param sector Первый сектор, к которому обращается хост
+ * @param count Количество секторов (в пределах одного блока)
+ * @param for_write true для записи секторов (чтение с карты может не понадобиться)
+ * @note Вызывается под cache_mutex; на время чтения с карты mutex отпускается
+ */
+static cache_block_t* cache_get_block(uint32_t sector, uint32_t count, bool for_write) {
+    uint32_t block_no = sector / CACHE_BLOCK_SECTORS;
+    uint8_t span = (uint8_t)(((1u << count) - 1) << (sector % CACHE_BLOCK_SECTORS));
+    cache_block_t* block = cache_find_block(block_no);
+    if (block == NULL && cache_reclaim()) {
+        block = cache_find_block(block_no);  // mutex отпускался
+    }
+    
+    if (block == NULL) {
+        // Промах кеша - загружаем блок.
+        // Промах записи только выделяет блок: при последовательной записи хост
+        // перезапишет его целиком, а недостающие секторы частично записанного
+        // блока будут дочитаны при первом чтении (valid_mask)
+        floppy_info.cache_misses++;
+        if (for_write) {
+            floppy_info.write_allocs++;
+        }
+        block = cache_load_block(block_no, !for_write);
+    } else if (!for_write && (block->valid_mask & span) != span) {
+        // Блок записан частично - дочитать недостающие секторы
+        floppy_info.cache_misses++;
+        floppy_info.partial_fills++;
+        if (!cache_fill_block(block)) {
+            return NULL;
+        }
+    } else {
+        // Попадание в кеш
+        floppy_info.cache_hits++;
+        if (block->prefetched) {
+            block->prefetched = false;
+            floppy_info.readahead_hits++;
+        }
+    }
     
     return block;
 }
 
 /**
- * @brief Чтение сектора через кеш
+ * @brief Детектор последовательного чтения: при возрастающей серии блоков
+ *        запросить у задачи FLOPPY упреждающее чтение следующих блоков
+ * @note Вызывается под cache_mutex из контекста USB, поэтому не блокируется
  */
-static bool cache_read_sector(uint32_t sector, uint8_t *buffer) {
-    if (sector >= FLOPPY_SECTORS) {
-        printf("[FLOPPY] Invalid sector: %lu\n", sector);
-        return false;
+static void cache_stream_update(uint32_t block_no) {
+    if (block_no == stream_last_block) {
+        return;  // Следующий сектор того же блока
     }
     
-    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    if (stream_last_block != UINT32_MAX && block_no == stream_last_block + 1) {
+        stream_run++;
+    } else {
+        // Серия прервана - начинаем новый поток
+        stream_run = 0;
+        stream_prefetched_to = block_no + 1;
+        stream_id++;
+    }
+    stream_last_block = block_no;
     
-    bool is_fat = (sector < FLOPPY_FAT12_SECTORS);
-    cache_block_t* block = cache_find_block(sector, is_fat);
+    if (stream_run < CACHE_READAHEAD_TRIGGER) {
+        return;
+    }
     
-    if (block == NULL) {
-        // Промах кеша - загружаем блок
-        floppy_info.cache_misses++;
-        block = cache_load_block(sector, is_fat);
+    // Держим окно упреждения на CACHE_READAHEAD_BLOCKS блоков впереди хоста
+    uint32_t total_blocks = (floppy_info.total_sectors + CACHE_BLOCK_SECTORS - 1) / CACHE_BLOCK_SECTORS;
+    uint32_t window_end = block_no + 1 + CACHE_READAHEAD_BLOCKS;
+    if (window_end > total_blocks) {
+        window_end = total_blocks;
+    }
+    if (stream_prefetched_to < block_no + 1) {
+        stream_prefetched_to = block_no + 1;
+    }
+    if (stream_prefetched_to >= window_end) {
+        return;
+    }
+    
+    floppy_message_t msg;
+    msg.command = FLOPPY_CMD_PREFETCH;
+    msg.data.prefetch.block = stream_prefetched_to;
+    msg.data.prefetch.count = window_end - stream_prefetched_to;
+    msg.data.prefetch.stream_id = stream_id;
+    
+    if (xQueueSend(floppy_queue, &msg, 0) == pdTRUE) {
+        stream_prefetched_to = window_end;
+    }
+}
+
+/**
+ * @brief Упреждающее чтение блоков в фоне (выполняется в задаче FLOPPY)
+ * @note Блок читается в prefetch_buffer без cache_mutex и копируется в кеш,
+ *       только если хост тем временем не загрузил его сам
+ */
+static void cache_prefetch(uint32_t first_block, uint32_t count, uint32_t id) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t block_no = first_block + i;
+        uint32_t block_start = block_no * CACHE_BLOCK_SECTORS;
+        
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+        
+        // Хост ушел в другое место или образ сменился - прекратить
+        if (id != stream_id || floppy_info.status != FLOPPY_STATUS_READY ||
+            block_start >= floppy_info.total_sectors) {
+            xSemaphoreGive(cache_mutex);
+            return;
+        }
+        
+        // Проверка без cache_find_block(): упреждение не должно продвигать блок в LRU
+        bool cached = (cache_peek_block(block_no) != NULL);
+        uint32_t sectors = floppy_info.total_sectors - block_start;
+        if (sectors > CACHE_BLOCK_SECTORS) {
+            sectors = CACHE_BLOCK_SECTORS;
+        }
+        
+        xSemaphoreGive(cache_mutex);
+        
+        if (cached) {
+            continue;
+        }
+        if (!sdcard_read_sectors(block_start, sectors, prefetch_buffer)) {
+            return;
+        }
+        
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
         
+        if (id != stream_id || floppy_info.status != FLOPPY_STATUS_READY) {
+            xSemaphoreGive(cache_mutex);
+            return;
+        }
+        
+        cache_reclaim();
+        if (cache_peek_block(block_no) == NULL) {
+            cache_block_t *block = cache_load_block(block_no, false);
+            if (block == NULL) {
+                xSemaphoreGive(cache_mutex);
+                return;
+            }
+            memcpy(block->data, prefetch_buffer, sectors * FLOPPY_SECTOR_SIZE);
+            block->valid_mask = (uint8_t)((1u << sectors) - 1);
+            block->prefetched = true;
+            floppy_info.readahead_blocks++;
+        }
+        
+        xSemaphoreGive(cache_mutex);
+    }
+}
+
+/**
+ * @brief Количество секторов от sector до конца его блока, не больше count
+ */
+static uint32_t cache_span_sectors(uint32_t sector, uint32_t count) {
+    uint32_t left = CACHE_BLOCK_SECTORS - (sector % CACHE_BLOCK_SECTORS);
+    return (count < left) ? count : left;
+}
+
+/**
+ * @brief Чтение нескольких секторов через кеш (по одному захвату mutex на блок)
+ * @note Копирование под тем же захватом mutex, что и поиск блока: ссылки
+ *       (refs) на время копирования не нужны
+ */
+static bool cache_read_sectors(uint32_t sector, uint32_t count, uint8_t *buffer) {
+    if (sector >= floppy_info.total_sectors || count > floppy_info.total_sectors - sector) {
+        printf("[FLOPPY] Invalid sector: %lu\n", sector);
+        return false;
+    }
+    
+    while (count > 0) {
+        uint32_t n = cache_span_sectors(sector, count);
+        
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+        
+        // Образ сменился или извлечен посреди многоблочного запроса
+        if (floppy_info.status != FLOPPY_STATUS_READY) {
+            xSemaphoreGive(cache_mutex);
+            return false;
+        }
+        
+        cache_block_t* block = cache_get_block(sector, n, false);
         if (block == NULL) {
             xSemaphoreGive(cache_mutex);
             return false;
         }
-    } else {
-        // Попадание в кеш
-        floppy_info.cache_hits++;
+        
+        if (!cache_resident) {
+            cache_stream_update(sector / CACHE_BLOCK_SECTORS);
+        }
+        last_io_tick = xTaskGetTickCount();
+        memcpy(buffer, &block->data[(sector - block->start_sector) * FLOPPY_SECTOR_SIZE],
+               n * FLOPPY_SECTOR_SIZE);
+        
+        xSemaphoreGive(cache_mutex);
+        
+        sector += n;
+        count -= n;
+        buffer += n * FLOPPY_SECTOR_SIZE;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Принять результат асинхронного дочитывания блока
+ * @return FLOPPY_READ_BUSY, пока чтение не завершено; FLOPPY_READ_OK - принято или нечего принимать
+ * @note Вызывается под cache_mutex
+ */
+static floppy_read_result_t cache_fill_collect(void) {
+    if (!cache_fill.active) {
+        return FLOPPY_READ_OK;
+    }
+    if (cache_fill.req.state == SDCARD_IO_PENDING) {
+        return FLOPPY_READ_BUSY;
     }
     
-    // Копируем нужный сектор из блока
-    uint32_t offset = (sector - block->start_sector) * FLOPPY_SECTOR_SIZE;
-    memcpy(buffer, &block->data[offset], FLOPPY_SECTOR_SIZE);
+    cache_fill.active = false;
+    cache_block_t *block = cache_fill.block;
+    if (block->refs > 0) {
+        block->refs--;
+    }
     
-    xSemaphoreGive(cache_mutex);
+    if (cache_fill.req.state != SDCARD_IO_DONE) {
+        printf("[FLOPPY] Failed to read sectors %lu+%lu\n", cache_fill.req.sector, cache_fill.req.count);
+        return FLOPPY_READ_ERROR;
+    }
+    
+    // Блок мог смениться только через cache_init(), который дожидается чтения
+    if (cache_peek_block(cache_fill.block_no) == block) {
+        block->valid_mask |= cache_fill.mask;
+    }
+    return FLOPPY_READ_OK;
+}
+
+/**
+ * @brief Отправить задаче SDCARD чтение первой серии недостающих секторов блока
+ * @note Вызывается под cache_mutex; блок захватывается до cache_fill_collect()
+ */
+static bool cache_fill_submit(cache_block_t *block, uint32_t block_no) {
+    // Не выходим за пределы образа
+    uint32_t end = (block->start_sector < floppy_info.total_sectors) ?
+                   floppy_info.total_sectors - block->start_sector : 0;
+    if (end > CACHE_BLOCK_SECTORS) {
+        end = CACHE_BLOCK_SECTORS;
+    }
+    
+    // Секторы, которые уже дочитывает cache_fill_block(), не запрашиваются
+    uint8_t present = block->valid_mask | block->filling;
+    uint32_t i = 0;
+    while (i < end && (present & (1u << i))) {
+        i++;
+    }
+    uint32_t run = 0;
+    while (i + run < end && !(present & (1u << (i + run)))) {
+        run++;
+    }
+    if (run == 0) {
+        return true;
+    }
+    
+    cache_fill.req.op = SDCARD_IO_READ;
+    cache_fill.req.sector = block->start_sector + i;
+    cache_fill.req.count = run;
+    cache_fill.req.buffer = &block->data[i * FLOPPY_SECTOR_SIZE];
+    cache_fill.req.callback = NULL;
+    cache_fill.req.notify_task = xTaskGetCurrentTaskHandle();
+    cache_fill.req.context = NULL;
+    cache_fill.block = block;
+    cache_fill.block_no = block_no;
+    cache_fill.mask = (uint8_t)(((1u << run) - 1) << i);
+    
+    if (!sdcard_submit_io(&cache_fill.req)) {
+        return false;
+    }
+    
+    block->refs++;
+    cache_fill.active = true;
     return true;
 }
 
 /**
- * @brief Запись сектора через кеш
+ * @brief Чтение секторов без ожидания SD карты
+ * 
+ * Попадания копируются сразу. При промахе блок выделяется, чтение
+ * недостающих секторов ставится в очередь задачи SDCARD и возвращается
+ * FLOPPY_READ_BUSY - вызывающий повторяет запрос после завершения.
  */
-static bool cache_write_sector(uint32_t sector, const uint8_t *buffer) {
-    if (sector >= FLOPPY_SECTORS) {
+static floppy_read_result_t cache_try_read_sectors(uint32_t sector, uint32_t count, uint8_t *buffer) {
+    if (sector >= floppy_info.total_sectors || count > floppy_info.total_sectors - sector) {
         printf("[FLOPPY] Invalid sector: %lu\n", sector);
-        return false;
+        return FLOPPY_READ_ERROR;
     }
     
-    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    while (count > 0) {
+        uint32_t n = cache_span_sectors(sector, count);
+        uint32_t block_no = sector / CACHE_BLOCK_SECTORS;
+        uint8_t span = (uint8_t)(((1u << n) - 1) << (sector % CACHE_BLOCK_SECTORS));
+        
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+        
+        // Блок, дочитанный для этого же запроса, уже посчитан как промах
+        bool filled = cache_fill.active && cache_fill.block_no == block_no;
+        floppy_read_result_t result = cache_fill_collect();
+        if (result != FLOPPY_READ_OK) {
+            xSemaphoreGive(cache_mutex);
+            return result;
+        }
+        
+        if (floppy_info.status != FLOPPY_STATUS_READY) {
+            xSemaphoreGive(cache_mutex);
+            return FLOPPY_READ_ERROR;
+        }
+        
+        cache_block_t *block = cache_find_block(block_no);
+        if (block == NULL && cache_reclaim()) {
+            block = cache_find_block(block_no);  // mutex отпускался
+        }
+        if (block == NULL || (block->valid_mask & span) != span) {
+            floppy_info.cache_misses++;
+            if (block == NULL) {
+                block = cache_load_block(block_no, false);
+            } else {
+                floppy_info.partial_fills++;
+            }
+            
+            bool ok = (block != NULL) && cache_fill_submit(block, block_no);
+            xSemaphoreGive(cache_mutex);
+            return ok ? FLOPPY_READ_BUSY : FLOPPY_READ_ERROR;
+        }
+        
+        if (!filled) {
+            floppy_info.cache_hits++;
+            if (block->prefetched) {
+                block->prefetched = false;
+                floppy_info.readahead_hits++;
+            }
+        }
+        if (!cache_resident) {
+            cache_stream_update(block_no);
+        }
+        last_io_tick = xTaskGetTickCount();
+        memcpy(buffer, &block->data[(sector - block->start_sector) * FLOPPY_SECTOR_SIZE],
+               n * FLOPPY_SECTOR_SIZE);
+        
+        xSemaphoreGive(cache_mutex);
+        
+        sector += n;
+        count -= n;
+        buffer += n * FLOPPY_SECTOR_SIZE;
+    }
     
-    bool is_fat = (sector < FLOPPY_FAT12_SECTORS);
-    cache_block_t* block = cache_find_block(sector, is_fat);
+    return FLOPPY_READ_OK;
+}
+
+/**
+ * @brief Запись нескольких секторов через кеш (по одному захвату mutex на блок)
+ */
+static bool cache_write_sectors(uint32_t sector, uint32_t count, const uint8_t *buffer) {
+    if (sector >= floppy_info.total_sectors || count > floppy_info.total_sectors - sector) {
+        printf("[FLOPPY] Invalid sector: %lu\n", sector);
+        return false;
+    }
     
-    if (block == NULL) {
-        // Промах кеша - загружаем блок
-        floppy_info.cache_misses++;
-        block = cache_load_block(sector, is_fat);
+    while (count > 0) {
+        uint32_t n = cache_span_sectors(sector, count);
+        
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
         
+        // Образ сменился или извлечен посреди многоблочного запроса
+        if (floppy_info.status != FLOPPY_STATUS_READY) {
+            xSemaphoreGive(cache_mutex);
+            return false;
+        }
+        
+        cache_block_t* block = cache_get_block(sector, n, true);
         if (block == NULL) {
             xSemaphoreGive(cache_mutex);
             return false;
         }
-    } else {
-        floppy_info.cache_hits++;
+        
+        // Секторы читаются с карты в этот блок - чтение затерло бы новые данные
+        uint32_t index = sector - block->start_sector;
+        uint8_t span = (uint8_t)(((1u << n) - 1) << index);
+        if (block->filling & span) {
+            xSemaphoreGive(cache_mutex);
+            vTaskDelay(1);
+            continue;
+        }
+        
+        // Записываем секторы в блок
+        memcpy(&block->data[index * FLOPPY_SECTOR_SIZE], buffer, n * FLOPPY_SECTOR_SIZE);
+        block->valid_mask |= span;
+        cache_mark_dirty(block, span);
+        last_io_tick = xTaskGetTickCount();
+        
+        xSemaphoreGive(cache_mutex);
+        
+        sector += n;
+        count -= n;
+        buffer += n * FLOPPY_SECTOR_SIZE;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Записать грязные блоки на SD карту сериями до CACHE_FLUSH_MAX_RUN блоков
+ * @param first_block Первый блок (pinned_blocks - без служебной области)
+ */
+static void cache_flush_all(uint32_t first_block) {
+    uint32_t total_blocks = (floppy_info.total_sectors + CACHE_BLOCK_SECTORS - 1) / CACHE_BLOCK_SECTORS;
+    TickType_t flush_start = xTaskGetTickCount();
+    
+    for (uint32_t block_no = first_block; block_no < total_blocks; ) {
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+        
+        // Без служебной области учитываются только грязные блоки данных:
+        // закрепленные FAT/root не мешают закончить проход досрочно
+        uint32_t dirty = (first_block < pinned_blocks) ? floppy_info.dirty_blocks : dirty_data_blocks;
+        if (dirty == 0) {
+            xSemaphoreGive(cache_mutex);
+            break;
+        }
+        
+        uint32_t blocks = 0;
+        cache_block_t *block = cache_peek_block(block_no);
+        if (block != NULL && block->dirty_mask != 0) {
+            cache_flush_run(block_no, &blocks);
+        }
+        
+        xSemaphoreGive(cache_mutex);
+        block_no += (blocks > 0) ? blocks : 1;
     }
     
-    // Записываем сектор в блок
-    uint32_t offset = (sector - block->start_sector) * FLOPPY_SECTOR_SIZE;
-    memcpy(&block->data[offset], buffer, FLOPPY_SECTOR_SIZE);
-    block->dirty = true;
-    block->timestamp = get_timestamp();
+    // Блоки, ставшие грязными во время записи, не старше начала записи
+    // (при пропуске служебной области ее блоки сохраняют свой возраст)
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    if (floppy_info.dirty_blocks > 0 && first_block == 0) {
+        first_dirty_tick = flush_start;
+    }
+    xSemaphoreGive(cache_mutex);
+}
+
+/**
+ * @brief Барьер записи: все записанное на SD карту попадает на носитель
+ * @return false, если карта сообщила об ошибке записи
+ * @note Только данные, уже записанные cache_flush_all(); f_sync образа и
+ *       проверка статуса карты выполняются один раз на все серии записи
+ */
+static bool cache_sync(void) {
+    // Дождаться записей, которые другая задача выполняет без cache_mutex
+    xSemaphoreTake(writeback_mutex, portMAX_DELAY);
     
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    bool pending = sync_pending;
+    sync_pending = false;
     xSemaphoreGive(cache_mutex);
+    
+    bool ok = !pending || sdcard_sync();
+    xSemaphoreGive(writeback_mutex);
+    
+    if (!pending) {
+        return true;
+    }
+    
+    floppy_info.syncs++;
+    if (!ok) {
+        floppy_info.sync_errors++;
+        printf("[FLOPPY] Sync failed: data written since the last sync may be lost\n");
+        return false;
+    }
     return true;
 }
 
+/**
+ * @brief Фоновая запись: по возрасту грязных данных или простою USB
+ * 
+ * По возрасту данные только уходят на карту (хост еще пишет), при простое
+ * после записи выполняется и барьер.
+ */
+static void cache_flush_check(void) {
+    if (floppy_info.status != FLOPPY_STATUS_READY ||
+        (floppy_info.dirty_blocks == 0 && !sync_pending)) {
+        return;
+    }
+    
+    // В резидентном режиме карта не трогается, пока хост активен
+    TickType_t now = xTaskGetTickCount();
+    bool aged = !cache_resident && floppy_info.dirty_blocks > 0 &&
+                (now - first_dirty_tick) >= pdMS_TO_TICKS(CACHE_FLUSH_AGE_MS);
+    bool idle = (now - last_io_tick) >= pdMS_TO_TICKS(CACHE_FLUSH_IDLE_MS);
+    
+    // Блоки, которые не удалось записать (карта извлечена), остаются грязными:
+    // cache_flush_all() сдвигает first_dirty_tick, повтор - не чаще CACHE_FLUSH_IDLE_MS
+    if (idle && floppy_info.dirty_blocks > 0 &&
+        (now - first_dirty_tick) < pdMS_TO_TICKS(CACHE_FLUSH_IDLE_MS)) {
+        idle = false;
+    }
+    
+    if (!aged && !idle) {
+        return;
+    }
+    
+    if (floppy_info.dirty_blocks > 0) {
+        printf("[FLOPPY] Background flush (%s): %lu dirty blocks\n",
+               aged ? "age" : "idle", floppy_info.dirty_blocks);
+        cache_flush_all(0);
+    }
+    if (idle) {
+        cache_sync();
+    }
+}
+
 /**
  * @brief Загрузка образа
  */
 static void floppy_load_image(const char *filename) {
     printf("[FLOPPY] Loading image: %s\n", filename);
     
+    // Смена статуса и очистка кеша под mutex, как при извлечении: обращение,
+    // начатое до смены образа, не увидит пул посреди переинициализации,
+    // а cache_init() дождется незавершенного дочитывания
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
     floppy_info.status = FLOPPY_STATUS_LOADING;
     strncpy(floppy_info.current_image, filename, sizeof(floppy_info.current_image) - 1);
     floppy_info.loaded_kb = 0;
-    
-    // Очистка кеша
     cache_init();
+    xSemaphoreGive(cache_mutex);
     
     // Отправка команды на загрузку образа в sdcard_task
     sdcard_message_t sd_msg;
     sd_msg.command = SDCARD_CMD_LOAD_IMAGE;
-    strncpy(sd_msg.data.filename, filename, 64);
+    strncpy(sd_msg.data.filename, filename, sizeof(sd_msg.data.filename) - 1);
+    sd_msg.data.filename[sizeof(sd_msg.data.filename) - 1] = '\0';
     xQueueSend(sdcard_queue, &sd_msg, portMAX_DELAY);
     
     // Задержка чтобы sdcard_task успел обработать команду загрузки
@@ -321,10 +1346,31 @@ static void floppy_load_image(const char *filename) {
     
     // Определить тип диска по размеру файла
     uint32_t file_size = sdcard_get_image_size();
+    uint32_t image_sectors = file_size / FLOPPY_SECTOR_SIZE;
     printf("[FLOPPY] File size: %lu bytes\n", file_size);
     
     floppy_info.disk_type = detect_floppy_type(file_size);
-    if (floppy_info.disk_type == FLOPPY_TYPE_UNKNOWN) {
+    const floppy_geometry_t *geometry = get_floppy_geometry(floppy_info.disk_type);
+    
+    // Размер служебной области берется из BPB образа; таблица форматов -
+    // запасной вариант для образов без корректного загрузочного сектора
+    uint32_t total_sectors = 0;
+    uint32_t meta_sectors = 0;
+    uint8_t boot_sector[FLOPPY_SECTOR_SIZE];
+    bool bpb_valid = sdcard_read_sector(0, boot_sector) &&
+                     floppy_parse_bpb(boot_sector, image_sectors, &total_sectors, &meta_sectors);
+    
+    if (!bpb_valid) {
+        if (geometry != NULL) {
+            printf("[FLOPPY] No valid BPB, using %s defaults\n", geometry->name);
+            total_sectors = geometry->sectors;
+            meta_sectors = geometry->fat_sectors;
+        }
+    } else if (geometry == NULL) {
+        floppy_info.disk_type = FLOPPY_TYPE_CUSTOM;
+    }
+    
+    if (meta_sectors == 0) {
         printf("[FLOPPY] Unknown disk format!\n");
         floppy_info.status = FLOPPY_STATUS_ERROR;
         
@@ -340,39 +1386,42 @@ static void floppy_load_image(const char *filename) {
         return;
     }
     
-    // Получить геометрию диска
-    const floppy_geometry_t *geometry = get_floppy_geometry(floppy_info.disk_type);
-    if (geometry == NULL) {
-        printf("[FLOPPY] Failed to get geometry!\n");
-        floppy_info.status = FLOPPY_STATUS_ERROR;
-        return;
-    }
+    floppy_info.total_sectors = total_sectors;
+    floppy_info.meta_sectors = meta_sectors;
+    floppy_info.total_fat_kb = (meta_sectors * FLOPPY_SECTOR_SIZE + 1023) / 1024;
+    
+    printf("[FLOPPY] Detected format: %s (%lu sectors, metadata: %lu sectors%s)\n",
+           geometry ? geometry->name : "custom", total_sectors, meta_sectors,
+           bpb_valid ? ", from BPB" : "");
     
-    floppy_info.total_sectors = geometry->sectors;
-    floppy_info.total_fat_kb = (geometry->fat_sectors * FLOPPY_SECTOR_SIZE) / 1024;
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    cache_set_pinned(meta_sectors, total_sectors);
+    xSemaphoreGive(cache_mutex);
     
-    printf("[FLOPPY] Detected format: %s (%lu sectors, FAT: %lu KB)\n",
-           geometry->name, floppy_info.total_sectors, floppy_info.total_fat_kb);
+    // Предзагружается закрепленная область: служебная или весь образ (резидентный режим)
+    uint32_t preload_sectors = cache_resident ? total_sectors : meta_sectors;
+    uint32_t preload_blocks = (preload_sectors + CACHE_BLOCK_SECTORS - 1) / CACHE_BLOCK_SECTORS;
+    uint32_t preload_kb = (preload_sectors * FLOPPY_SECTOR_SIZE + 1023) / 1024;
+    const char *preload_title = cache_resident ? "Loading image..." : "Loading FAT...";
     
     // Отображение статуса загрузки на OLED
     oled_message_t oled_msg;
     oled_msg.command = OLED_CMD_SHOW_STATUS;
-    strcpy(oled_msg.data.status.status_line1, "Loading FAT...");
-    snprintf(oled_msg.data.status.status_line2, 32, "0 / %lu KB", floppy_info.total_fat_kb);
+    strcpy(oled_msg.data.status.status_line1, preload_title);
+    snprintf(oled_msg.data.status.status_line2, 32, "0 / %lu KB", preload_kb);
     
     extern QueueHandle_t oled_queue;
     if (oled_queue != NULL) {
         xQueueSend(oled_queue, &oled_msg, pdMS_TO_TICKS(100));
     }
     
-    // Предзагрузка FAT области в кеш
-    printf("[FLOPPY] Preloading FAT area (%lu sectors)...\n", geometry->fat_sectors);
+    // Предзагрузка закрепленных блоков: по одному многосекторному чтению на блок
+    printf("[FLOPPY] Preloading %s (%lu sectors)...\n",
+           cache_resident ? "whole image" : "metadata area", preload_sectors);
     
-    for (uint32_t sector = 0; sector < geometry->fat_sectors; sector++) {
-        uint8_t temp_buffer[FLOPPY_SECTOR_SIZE];
-        
-        printf("[FLOPPY] Preloading sector %lu...\n", sector);
-        if (!cache_read_sector(sector, temp_buffer)) {
+    for (uint32_t block_no = 0; block_no < preload_blocks; block_no++) {
+        if (!cache_preload_block(block_no)) {
+            uint32_t sector = block_no * CACHE_BLOCK_SECTORS;
             printf("[FLOPPY] Failed to preload sector %lu\n", sector);
             floppy_info.status = FLOPPY_STATUS_ERROR;
             
@@ -386,14 +1435,14 @@ static void floppy_load_image(const char *filename) {
             return;
         }
         
-        // Обновление прогресса каждые 4 сектора (2KB)
-        if ((sector % 4) == 0) {
-            floppy_info.loaded_kb = (sector * FLOPPY_SECTOR_SIZE) / 1024;
+        // Обновление прогресса каждые 4 блока (16KB)
+        if ((block_no % 4) == 0) {
+            floppy_info.loaded_kb = (block_no * CACHE_BLOCK_SIZE) / 1024;
             
             oled_msg.command = OLED_CMD_SHOW_STATUS;
-            strcpy(oled_msg.data.status.status_line1, "Loading FAT...");
+            strcpy(oled_msg.data.status.status_line1, preload_title);
             snprintf(oled_msg.data.status.status_line2, 32, "%lu / %lu KB", 
-                    floppy_info.loaded_kb, floppy_info.total_fat_kb);
+                    floppy_info.loaded_kb, preload_kb);
             
             if (oled_queue != NULL) {
                 xQueueSend(oled_queue, &oled_msg, 0);
@@ -402,10 +1451,11 @@ static void floppy_load_image(const char *filename) {
     }
     
     floppy_info.status = FLOPPY_STATUS_READY;
-    floppy_info.loaded_kb = floppy_info.total_fat_kb;
+    floppy_info.loaded_kb = preload_kb;
     
     printf("[FLOPPY] Image loaded successfully\n");
-    printf("[FLOPPY] FAT area: %lu KB in cache\n", floppy_info.total_fat_kb);
+    printf("[FLOPPY] %s: %lu KB in cache\n",
+           cache_resident ? "Resident image" : "FAT area", preload_kb);
     
     // Menu task сам обнаружит через floppy_is_ready() и переключится в DISK_LOADED
 }
@@ -417,19 +1467,30 @@ static void floppy_load_image(const char *filename) {
 static void floppy_eject_image(void) {
     printf("[FLOPPY] Ejecting image\n");
     
+    // Записать все грязные блоки (FAT область тоже может быть изменена хостом)
+    cache_flush_all(0);
+    cache_sync();
+    
     xSemaphoreTake(cache_mutex, portMAX_DELAY);
     
-    // Записать все грязные блоки
-    for (int i = 0; i < CACHE_DATA_BLOCKS; i++) {
-        if (data_cache[i].valid && data_cache[i].dirty) {
-            printf("[FLOPPY] Flushing dirty block at sector %lu\n", data_cache[i].start_sector);
-            for (uint32_t s = 0; s < CACHE_BLOCK_SECTORS; s++) {
-                sdcard_write_sector(data_cache[i].start_sector + s,
-                                   &data_cache[i].data[s * FLOPPY_SECTOR_SIZE]);
-            }
-        }
+    if (floppy_info.dirty_blocks > 0) {
+        printf("[FLOPPY] Warning: %lu dirty blocks lost on eject\n", floppy_info.dirty_blocks);
     }
     
+    // Статистика кеша для сравнения политик замещения
+    uint32_t total = floppy_info.cache_hits + floppy_info.cache_misses;
+    printf("[FLOPPY] Cache stats (%s%s): hits %lu, misses %lu (%lu%% hit), ghost hits %lu, evictions %lu\n",
+           (CACHE_POLICY == CACHE_POLICY_2Q) ? "2Q" : "LRU",
+           cache_resident ? ", resident" : "",
+           floppy_info.cache_hits, floppy_info.cache_misses,
+           total ? (floppy_info.cache_hits * 100) / total : 0,
+           floppy_info.cache_ghost_hits, floppy_info.cache_evictions);
+    printf("[FLOPPY] Read-ahead: %lu blocks prefetched, %lu used\n",
+           floppy_info.readahead_blocks, floppy_info.readahead_hits);
+    printf("[FLOPPY] Writes: %lu sectors flushed, %lu blocks allocated without read, %lu partial fills\n",
+           floppy_info.flushed_sectors, floppy_info.write_allocs, floppy_info.partial_fills);
+    printf("[FLOPPY] Sync barriers: %lu, failed %lu\n", floppy_info.syncs, floppy_info.sync_errors);
+    
     // Очистка кеша
     cache_init();
     
@@ -462,7 +1523,7 @@ void floppy_emu_task(void *pvParameters) {
     floppy_message_t msg;
     
     while (1) {
-        if (xQueueReceive(floppy_queue, &msg, pdMS_TO_TICKS(100)) == pdTRUE) {
+        if (xQueueReceive(floppy_queue, &msg, pdMS_TO_TICKS(CACHE_FLUSH_POLL_MS)) == pdTRUE) {
             switch (msg.command) {
                 case FLOPPY_CMD_LOAD_IMAGE:
                     floppy_load_image(msg.data.filename);
@@ -473,11 +1534,25 @@ void floppy_emu_task(void *pvParameters) {
                     break;
                     
                 case FLOPPY_CMD_READ_SECTOR:
-                    cache_read_sector(msg.data.io.sector, msg.data.io.buffer);
+                    cache_read_sectors(msg.data.io.sector, 1, msg.data.io.buffer);
                     break;
                     
                 case FLOPPY_CMD_WRITE_SECTOR:
-                    cache_write_sector(msg.data.io.sector, msg.data.io.buffer);
+                    cache_write_sectors(msg.data.io.sector, 1, msg.data.io.buffer);
+                    break;
+                    
+                case FLOPPY_CMD_PREFETCH:
+                    cache_prefetch(msg.data.prefetch.block, msg.data.prefetch.count,
+                                   msg.data.prefetch.stream_id);
+                    break;
+                    
+                case FLOPPY_CMD_FLUSH:
+                    // Служебная область хост переписывает постоянно - ее
+                    // запишет простой или SYNCHRONIZE CACHE
+                    flush_queued = false;
+                    if (floppy_info.status == FLOPPY_STATUS_READY) {
+                        cache_flush_all(pinned_blocks);
+                    }
                     break;
                     
                 default:
@@ -485,6 +1560,9 @@ void floppy_emu_task(void *pvParameters) {
                     break;
             }
         }
+        
+        // Фоновая запись грязных блоков
+        cache_flush_check();
     }
 }
 
@@ -496,7 +1574,8 @@ void floppy_emu_task_init(void) {
     
     // Создание mutex для кеша
     cache_mutex = xSemaphoreCreateMutex();
-    if (cache_mutex == NULL) {
+    writeback_mutex = xSemaphoreCreateMutex();
+    if (cache_mutex == NULL || writeback_mutex == NULL) {
         printf("[FLOPPY] Failed to create mutex!\n");
         return;
     }
@@ -527,10 +1606,8 @@ void floppy_emu_task_init(void) {
     }
     
     printf("[FLOPPY] Task initialized successfully\n");
-    printf("[FLOPPY] Cache size: FAT=%d KB, Data=%d KB, Total=%d KB\n",
-           (CACHE_FAT_BLOCKS * CACHE_BLOCK_SIZE) / 1024,
-           (CACHE_DATA_BLOCKS * CACHE_BLOCK_SIZE) / 1024,
-           CACHE_TOTAL_SIZE / 1024);
+    printf("[FLOPPY] Cache size: %d KB (%d blocks, up to %d pinned for metadata)\n",
+           CACHE_TOTAL_SIZE / 1024, CACHE_TOTAL_BLOCKS, CACHE_MAX_PINNED_BLOCKS);
 }
 
 /**
@@ -540,7 +1617,36 @@ bool floppy_read_sector(uint32_t sector, uint8_t *buffer) {
     if (floppy_info.status != FLOPPY_STATUS_READY) {
         return false;
     }
-    return cache_read_sector(sector, buffer);
+    return cache_read_sectors(sector, 1, buffer);
+}
+
+/**
+ * @brief API: Чтение нескольких секторов (для USB MSC)
+ */
+bool floppy_read_sectors(uint32_t sector, uint32_t count, uint8_t *buffer) {
+    if (floppy_info.status != FLOPPY_STATUS_READY) {
+        return false;
+    }
+    return cache_read_sectors(sector, count, buffer);
+}
+
+/**
+ * @brief API: Чтение секторов без блокировки на SD карте (для USB MSC)
+ * @return FLOPPY_READ_BUSY - данные читаются с карты, повторить вызов с теми же параметрами
+ */
+floppy_read_result_t floppy_try_read_sectors(uint32_t sector, uint32_t count, uint8_t *buffer) {
+    if (floppy_info.status != FLOPPY_STATUS_READY) {
+        return FLOPPY_READ_ERROR;
+    }
+    return cache_try_read_sectors(sector, count, buffer);
+}
+
+/**
+ * @brief API: Подождать завершения чтения после FLOPPY_READ_BUSY
+ * @param timeout Максимальное ожидание (уведомление приходит вызвавшей задаче)
+ */
+void floppy_wait_read(TickType_t timeout) {
+    ulTaskNotifyTakeIndexed(SDCARD_IO_NOTIFY_INDEX, pdTRUE, timeout);
 }
 
 /**
@@ -550,7 +1656,62 @@ bool floppy_write_sector(uint32_t sector, const uint8_t *buffer) {
     if (floppy_info.status != FLOPPY_STATUS_READY) {
         return false;
     }
-    return cache_write_sector(sector, buffer);
+    return cache_write_sectors(sector, 1, buffer);
+}
+
+/**
+ * @brief API: Запись нескольких секторов (для USB MSC)
+ */
+bool floppy_write_sectors(uint32_t sector, uint32_t count, const uint8_t *buffer) {
+    if (floppy_info.status != FLOPPY_STATUS_READY) {
+        return false;
+    }
+    return cache_write_sectors(sector, count, buffer);
+}
+
+/**
+ * @brief API: Конец команды записи хоста (tud_msc_write10_complete_cb)
+ * 
+ * Запускает запись данных на карту в задаче FLOPPY, не дожидаясь возраста
+ * или простоя; барьер не выполняется. Не блокируется.
+ */
+void floppy_write_complete(void) {
+    if (floppy_info.status != FLOPPY_STATUS_READY || cache_resident || flush_queued) {
+        return;
+    }
+    
+    floppy_message_t msg;
+    msg.command = FLOPPY_CMD_FLUSH;
+    flush_queued = true;
+    if (xQueueSend(floppy_queue, &msg, 0) != pdTRUE) {
+        flush_queued = false;
+    }
+}
+
+/**
+ * @brief API: Записать все грязные блоки и выполнить барьер (SYNCHRONIZE CACHE)
+ * @return false, если часть данных не попала на карту
+ * @note Блокирует вызывающую задачу на время записи
+ */
+bool floppy_flush(void) {
+    if (floppy_info.status != FLOPPY_STATUS_READY) {
+        return true;
+    }
+    
+    // Считаются ошибки записи за время вызова, в том числе серий, которые
+    // другая задача записывала параллельно: их данные тоже принял хост
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    uint32_t failures = writeback_failures;
+    xSemaphoreGive(cache_mutex);
+    
+    cache_flush_all(0);
+    bool synced = cache_sync();
+    
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    bool written = (writeback_failures == failures);
+    xSemaphoreGive(cache_mutex);
+    
+    return synced && written;
 }
 
 /**
@@ -14,9 +14,14 @@
 // Типы флоппи-дисков
 typedef enum {
     FLOPPY_TYPE_UNKNOWN = 0,
+    FLOPPY_TYPE_160K,       // 160 KB (SS 5.25", 8 секторов)
+    FLOPPY_TYPE_180K,       // 180 KB (SS 5.25", 9 секторов)
+    FLOPPY_TYPE_320K,       // 320 KB (DS 5.25", 8 секторов)
+    FLOPPY_TYPE_360K,       // 360 KB (DS 5.25", 9 секторов)
     FLOPPY_TYPE_720K,       // 720 KB (DD)
     FLOPPY_TYPE_1200K,      // 1.2 MB (HD 5.25")
-    FLOPPY_TYPE_1440K       // 1.44 MB (HD 3.5")
+    FLOPPY_TYPE_1440K,      // 1.44 MB (HD 3.5")
+    FLOPPY_TYPE_CUSTOM      // Нестандартный размер, геометрия из BPB образа
 } floppy_type_t;
 
 // Параметры разных типов дисков
@@ -24,27 +29,43 @@ typedef struct {
     floppy_type_t type;
     const char *name;
     uint32_t sectors;       // Общее количество секторов
-    uint32_t fat_sectors;   // Количество секторов для FAT области
+    uint32_t fat_sectors;   // Служебная область по умолчанию (если BPB образа не читается)
 } floppy_geometry_t;
 
 // Геометрия различных форматов
 static const floppy_geometry_t floppy_formats[] = {
-    { FLOPPY_TYPE_720K,  "720K",  1440, 14 },  // 720KB:  boot(1) + FATs(2*3) + root(7) = 14 sectors
-    { FLOPPY_TYPE_1200K, "1.2M",  2400, 19 },  // 1.2MB:  boot(1) + FATs(2*7) + root(14) = 29? need check
+    { FLOPPY_TYPE_160K,  "160K",  320,  7 },   // 160KB:  boot(1) + FATs(2*1) + root(4)  = 7 sectors
+    { FLOPPY_TYPE_180K,  "180K",  360,  9 },   // 180KB:  boot(1) + FATs(2*2) + root(4)  = 9 sectors
+    { FLOPPY_TYPE_320K,  "320K",  640,  10 },  // 320KB:  boot(1) + FATs(2*1) + root(7)  = 10 sectors
+    { FLOPPY_TYPE_360K,  "360K",  720,  12 },  // 360KB:  boot(1) + FATs(2*2) + root(7)  = 12 sectors
+    { FLOPPY_TYPE_720K,  "720K",  1440, 14 },  // 720KB:  boot(1) + FATs(2*3) + root(7)  = 14 sectors
+    { FLOPPY_TYPE_1200K, "1.2M",  2400, 29 },  // 1.2MB:  boot(1) + FATs(2*7) + root(14) = 29 sectors
     { FLOPPY_TYPE_1440K, "1.44M", 2880, 33 }   // 1.44MB: boot(1) + FATs(2*9) + root(14) = 33 sectors
 };
 
+#define FLOPPY_FORMAT_COUNT     (sizeof(floppy_formats) / sizeof(floppy_formats[0]))
+
 // Для обратной совместимости
 #define FLOPPY_SECTORS          2880  // 1.44MB / 512 bytes (максимальный размер)
-#define FLOPPY_FAT12_SECTORS    33    // FAT12 для 1.44MB (максимальный размер)
 
 // Конфигурация кеша - зависит от платформы
-#define CACHE_TOTAL_SIZE        (CACHE_SIZE_KB * 1024)  // 320KB для Pico2, 160KB для Pico1
-#define CACHE_BLOCK_SECTORS     8                        // Блок = 8 секторов (4KB)
+#define CACHE_TOTAL_SIZE        (CACHE_SIZE_KB * 1024)  // 320KB для Pico2, 100KB для Pico1
+#define CACHE_BLOCK_SECTORS     8                        // Блок = 8 секторов (4KB), по биту на сектор в масках блока
 #define CACHE_BLOCK_SIZE        (CACHE_BLOCK_SECTORS * FLOPPY_SECTOR_SIZE)
-#define CACHE_FAT_BLOCKS        ((FLOPPY_FAT12_SECTORS + CACHE_BLOCK_SECTORS - 1) / CACHE_BLOCK_SECTORS) // ~5 блоков для FAT
-#define CACHE_DATA_SIZE         (CACHE_TOTAL_SIZE - (CACHE_FAT_BLOCKS * CACHE_BLOCK_SIZE))
-#define CACHE_DATA_BLOCKS       (CACHE_DATA_SIZE / CACHE_BLOCK_SIZE)  // ~75 блоков данных
+#define CACHE_TOTAL_BLOCKS      (CACHE_TOTAL_SIZE / CACHE_BLOCK_SIZE)  // 80 блоков (Pico2) / 25 (Pico1)
+#define CACHE_MAX_PINNED_BLOCKS 8                        // Предел закрепленной служебной области (32KB)
+#define CACHE_MAP_BLOCKS        ((FLOPPY_SECTORS + CACHE_BLOCK_SECTORS - 1) / CACHE_BLOCK_SECTORS) // 360 блоков в образе
+#define CACHE_NO_SLOT           (-1)                     // Блок отсутствует в кеше
+
+// Упреждающее чтение при последовательном доступе
+#define CACHE_READAHEAD_TRIGGER 2                        // Блоков подряд до включения упреждения
+#define CACHE_READAHEAD_BLOCKS  4                        // Окно упреждения (16KB)
+
+// Фоновая запись грязных блоков
+#define CACHE_FLUSH_AGE_MS      1000                     // Максимальный возраст грязных данных
+#define CACHE_FLUSH_IDLE_MS     200                      // Запись и барьер после простоя USB
+#define CACHE_FLUSH_POLL_MS     50                       // Период проверки в задаче FLOPPY
+#define CACHE_FLUSH_MAX_RUN     8                        // Блоков в одной серии записи (32KB)
 
 // Команды для эмулятора
 typedef enum {
@@ -52,19 +73,26 @@ typedef enum {
     FLOPPY_CMD_EJECT_IMAGE,     // Извлечь образ
     FLOPPY_CMD_READ_SECTOR,     // Прочитать сектор (от USB MSC)
     FLOPPY_CMD_WRITE_SECTOR,    // Записать сектор (от USB MSC)
-    FLOPPY_CMD_GET_STATUS       // Получить статус
+    FLOPPY_CMD_GET_STATUS,      // Получить статус
+    FLOPPY_CMD_PREFETCH,        // Упреждающее чтение блоков (от детектора потока)
+    FLOPPY_CMD_FLUSH            // Запись данных на карту после WRITE10 (без барьера)
 } floppy_cmd_t;
 
 // Структура сообщения для эмулятора
 typedef struct {
     floppy_cmd_t command;
     union {
-        char filename[64];          // Для LOAD_IMAGE
+        char filename[IMAGE_PATH_MAX];  // Для LOAD_IMAGE
         struct {
             uint32_t sector;        // Номер сектора
             uint8_t *buffer;        // Буфер данных
             void *callback_param;   // Параметр для callback
         } io;
+        struct {
+            uint32_t block;         // Первый блок для упреждающего чтения
+            uint32_t count;         // Количество блоков
+            uint32_t stream_id;     // Номер потока (устаревшие запросы отбрасываются)
+        } prefetch;
     } data;
 } floppy_message_t;
 
@@ -76,16 +104,37 @@ typedef enum {
     FLOPPY_STATUS_ERROR             // Ошибка
 } floppy_status_t;
 
+// Результат чтения без ожидания SD карты
+typedef enum {
+    FLOPPY_READ_OK,                 // Данные скопированы
+    FLOPPY_READ_BUSY,               // Промах: чтение поставлено в очередь SD карты
+    FLOPPY_READ_ERROR               // Ошибка
+} floppy_read_result_t;
+
 // Информация о загрузке
 typedef struct {
     floppy_status_t status;
-    char current_image[64];
+    char current_image[IMAGE_PATH_MAX];
     floppy_type_t disk_type;        // Тип диска (720K/1.2M/1.44M)
     uint32_t total_sectors;         // Общее количество секторов
     uint32_t loaded_kb;             // Загружено KB (для FAT области)
     uint32_t total_fat_kb;          // Размер FAT области в KB
+    uint32_t meta_sectors;          // Служебная область образа по BPB (boot + FATs + root)
+    uint32_t pinned_blocks;         // Закрепленных блоков кеша под служебную область
+    bool resident;                  // Образ целиком в RAM (CACHE_RESIDENT_MODE)
+    uint8_t cache_policy;           // Политика замещения (CACHE_POLICY_LRU / CACHE_POLICY_2Q)
     uint32_t cache_hits;            // Попадания в кеш
     uint32_t cache_misses;          // Промахи кеша
+    uint32_t cache_ghost_hits;      // 2Q: промахи по блокам из призрачного списка A1out
+    uint32_t cache_evictions;       // Вытеснения блоков из кеша данных
+    uint32_t readahead_blocks;      // Блоков загружено упреждающим чтением
+    uint32_t readahead_hits;        // Из них затем запрошено хостом
+    uint32_t dirty_blocks;          // Грязных блоков в кеше (ожидают записи)
+    uint32_t flushed_sectors;       // Секторов записано на SD карту
+    uint32_t write_allocs;          // Промахов записи, обслуженных без чтения с карты
+    uint32_t partial_fills;         // Дочитываний частично записанных блоков
+    uint32_t syncs;                 // Барьеров записи (sdcard_sync)
+    uint32_t sync_errors;           // Из них с ошибкой
 } floppy_info_t;
 
 // Глобальная очередь для эмулятора
@@ -100,6 +149,12 @@ void floppy_emu_task(void *pvParameters);
 // API функции
 bool floppy_read_sector(uint32_t sector, uint8_t *buffer);
 bool floppy_write_sector(uint32_t sector, const uint8_t *buffer);
+bool floppy_read_sectors(uint32_t sector, uint32_t count, uint8_t *buffer);
+bool floppy_write_sectors(uint32_t sector, uint32_t count, const uint8_t *buffer);
+floppy_read_result_t floppy_try_read_sectors(uint32_t sector, uint32_t count, uint8_t *buffer);
+void floppy_wait_read(TickType_t timeout);
+void floppy_write_complete(void);
+bool floppy_flush(void);
 bool floppy_is_ready(void);
 const floppy_info_t* floppy_get_info(void);
 
@@ -7,26 +7,106 @@
 #include <stdio.h>
 #include <string.h>
 
-#define MAX_IMAGES 32  // Максимум файлов (совпадает с sdcard_task.h)
-
 // Очередь для событий от control_task
 QueueHandle_t menu_queue = NULL;
 
 // Текущее состояние меню
 static menu_state_t current_state = MENU_STATE_MAIN;
-static uint8_t selected_index = 0;
-static uint8_t scroll_offset = 0;
-static uint8_t selected_file_index = 0;  // Сохраненный индекс выбранного файла
+static uint16_t selected_index = 0;
+static uint16_t scroll_offset = 0;
+static uint16_t selected_file_index = 0; // Сохраненный индекс выбранного файла
 static uint8_t confirm_choice = 0;       // 0=Yes, 1=No для подтверждения
 static uint8_t eject_choice = 0;         // 0=Yes, 1=No для извлечения
 
 // Навигация по каталогам
-static char current_path[128] = "/";     // Текущий путь
+static char current_path[IMAGE_PATH_MAX] = "/";  // Текущий путь
 static bool in_subdirectory = false;     // Находимся в подкаталоге
 
-// Список файлов (будет заполняться из sdcard_task)
-static char file_list[MAX_IMAGES][32];
-static uint8_t file_count = 0;
+// Список файлов: в RAM только страница записей вокруг видимых строк,
+// ее заполняет sdcard_task по запросу. Пункт 0 - "< Back", пункт i - запись i - 1
+static sdcard_dir_page_t dir_page;
+static uint8_t dir_requests = 0;         // Запросов страниц без ответа (dir_page занята sdcard_task)
+static bool dir_end_known = false;       // Последняя запись каталога уже встречалась
+static uint16_t dir_total = 0;           // Записей в каталоге (если dir_end_known)
+static char selected_name[SDCARD_NAME_MAX];  // Файл на экране подтверждения
+
+/**
+ * @brief Запись каталога для пункта списка, если она в загруженной странице
+ */
+static const sdcard_dir_entry_t* dir_entry(uint16_t item) {
+    if (item == 0 || dir_requests > 0) {
+        return NULL;
+    }
+    uint16_t index = item - 1;
+    if (index < dir_page.offset || index >= dir_page.offset + dir_page.count) {
+        return NULL;
+    }
+    return &dir_page.entries[index - dir_page.offset];
+}
+
+/**
+ * @brief Запросить страницу каталога current_path начиная с записи offset
+ */
+static void request_dir_page(uint16_t offset) {
+    sdcard_message_t sd_msg;
+    sd_msg.command = SDCARD_CMD_LIST_IMAGES;
+    strncpy(sd_msg.data.list.path, current_path, sizeof(sd_msg.data.list.path) - 1);
+    sd_msg.data.list.path[sizeof(sd_msg.data.list.path) - 1] = '\0';
+    sd_msg.data.list.offset = offset;
+    sd_msg.data.list.count = SDCARD_LIST_PAGE_MAX;
+    sd_msg.data.list.page = &dir_page;
+    
+    dir_requests++;
+    xQueueSend(sdcard_queue, &sd_msg, portMAX_DELAY);
+}
+
+/**
+ * @brief Открыть каталог current_path: первая страница и экран загрузки
+ */
+static void open_directory(void) {
+    printf("[MENU] Opening directory: %s\n", current_path);
+    
+    dir_end_known = false;
+    dir_total = 0;
+    selected_index = 0;
+    scroll_offset = 0;
+    request_dir_page(0);
+}
+
+/**
+ * @brief Догрузить страницу, если видимые строки вышли за загруженную
+ * @return true если запрос отправлен (экран обновится по ответу)
+ * 
+ * Вниз страница начинается с первой видимой записи, вверх - так, чтобы
+ * видимые строки оказались в ее конце.
+ */
+static bool ensure_dir_window(void) {
+    uint16_t first = (scroll_offset > 0) ? scroll_offset - 1 : 0;
+    uint16_t last = scroll_offset + MENU_ITEMS_PER_PAGE - 2;   // Пункт 0 - "< Back"
+    if (dir_end_known) {
+        if (dir_total == 0) {
+            return false;
+        }
+        if (last >= dir_total) {
+            last = dir_total - 1;
+        }
+    }
+    
+    if (first >= dir_page.offset && last < dir_page.offset + dir_page.count) {
+        return false;
+    }
+    if (first >= dir_page.offset && dir_page.end) {
+        return false;   // За концом каталога нечего загружать
+    }
+    
+    uint16_t back = SDCARD_LIST_PAGE_MAX - (MENU_ITEMS_PER_PAGE - 1);
+    if (first < dir_page.offset) {
+        request_dir_page(first > back ? first - back : 0);
+    } else {
+        request_dir_page(first);
+    }
+    return true;
+}
 
 /**
  * @brief Обновление отображения меню на OLED
@@ -39,32 +119,34 @@ static void update_oled_menu(void) {
         case MENU_STATE_MAIN:
             strcpy(msg.data.menu.items[0], "Select Image");
             strcpy(msg.data.menu.items[1], "SD Card Info");
-            strcpy(msg.data.menu.items[2], "");
+            strcpy(msg.data.menu.items[2], "SD Benchmark");
             msg.data.menu.item_count = 3;
             msg.data.menu.selected_index = selected_index;
             break;
             
         case MENU_STATE_FILE_LIST: {
-            // Показываем файлы с учетом прокрутки
-            // Первый пункт всегда "< Back"
+            // Показываем записи загруженной страницы с учетом прокрутки
+            // Первый пункт всегда "< Back", каталоги - в скобках
             msg.data.menu.item_count = 0;
             
-            if (scroll_offset == 0) {
-                // Первая страница - показываем "< Back"
-                strcpy(msg.data.menu.items[0], "< Back");
-                msg.data.menu.item_count = 1;
+            for (uint8_t i = 0; i < MENU_ITEMS_PER_PAGE; i++) {
+                uint16_t item = scroll_offset + i;
+                char *line = msg.data.menu.items[i];
                 
-                // Заполняем остальные пункты файлами
-                for (uint8_t i = 1; i < MENU_ITEMS_PER_PAGE && i < file_count; i++) {
-                    strcpy(msg.data.menu.items[i], file_list[i]);
-                    msg.data.menu.item_count++;
-                }
-            } else {
-                // Не первая страница - показываем только файлы
-                for (uint8_t i = 0; i < MENU_ITEMS_PER_PAGE && (scroll_offset + i) < file_count; i++) {
-                    strcpy(msg.data.menu.items[i], file_list[scroll_offset + i]);
-                    msg.data.menu.item_count++;
+                if (item == 0) {
+                    strcpy(line, "< Back");
+                } else {
+                    const sdcard_dir_entry_t *entry = dir_entry(item);
+                    if (entry == NULL) {
+                        break;
+                    }
+                    if (entry->is_dir) {
+                        snprintf(line, 32, "[%.29s]", entry->name);
+                    } else {
+                        snprintf(line, 32, "%.31s", entry->name);
+                    }
                 }
+                msg.data.menu.item_count++;
             }
             
             msg.data.menu.selected_index = selected_index - scroll_offset;
@@ -78,8 +160,15 @@ static void update_oled_menu(void) {
             msg.data.menu.selected_index = 0;
             break;
             
+        case MENU_STATE_BENCHMARK:
+            strcpy(msg.data.menu.items[0], "SD Benchmark");
+            strcpy(msg.data.menu.items[1], "Press OK");
+            msg.data.menu.item_count = 2;
+            msg.data.menu.selected_index = 0;
+            break;
+            
         case MENU_STATE_FILE_CONFIRM:
-            snprintf(msg.data.menu.items[0], 32, "Load %.20s?", file_list[selected_file_index]);
+            snprintf(msg.data.menu.items[0], 32, "Load %.20s?", selected_name);
             if (confirm_choice == 0) {
                 strcpy(msg.data.menu.items[1], "> Yes");
                 strcpy(msg.data.menu.items[2], "  No");
@@ -105,9 +194,14 @@ static void update_oled_menu(void) {
             if (info != NULL) {
                 const char *size_str = "???";
                 switch (info->disk_type) {
+                    case FLOPPY_TYPE_160K:  size_str = "160K"; break;
+                    case FLOPPY_TYPE_180K:  size_str = "180K"; break;
+                    case FLOPPY_TYPE_320K:  size_str = "320K"; break;
+                    case FLOPPY_TYPE_360K:  size_str = "360K"; break;
                     case FLOPPY_TYPE_720K:  size_str = "720K"; break;
                     case FLOPPY_TYPE_1200K: size_str = "1.2M"; break;
                     case FLOPPY_TYPE_1440K: size_str = "1.44M"; break;
+                    case FLOPPY_TYPE_CUSTOM: size_str = "BPB"; break;
                     default: size_str = "???"; break;
                 }
                 snprintf(msg.data.menu.items[0], 32, "Disk Ready %s", size_str);
@@ -148,15 +242,20 @@ static void update_oled_menu(void) {
  * @brief Обработка событий навигации вверх/вниз
  */
 static void handle_navigation(bool is_up) {
-    uint8_t max_index = 0;
+    uint16_t max_index = 0;
     
     switch (current_state) {
         case MENU_STATE_MAIN:
-            max_index = 1;  // 2 пункта: Select Image, SD Card Info
+            max_index = 2;  // 3 пункта: Select Image, SD Card Info, SD Benchmark
             break;
             
         case MENU_STATE_FILE_LIST:
-            max_index = file_count > 0 ? file_count - 1 : 0;
+            // Пока страница читается, выбор не меняется; конец каталога
+            // может быть еще неизвестен - тогда его покажет следующая страница
+            if (dir_requests > 0) {
+                return;
+            }
+            max_index = dir_end_known ? dir_total : UINT16_MAX - 1;
             break;
             
         case MENU_STATE_FILE_CONFIRM:
@@ -193,6 +292,11 @@ static void handle_navigation(bool is_up) {
         }
     }
     
+    // Новая страница списка: экран обновится по ответу sdcard_task
+    if (current_state == MENU_STATE_FILE_LIST && ensure_dir_window()) {
+        return;
+    }
+    
     update_oled_menu();
 }
 
@@ -211,10 +315,7 @@ static void handle_ok_press(void) {
                 strcpy(current_path, "/");
                 in_subdirectory = false;
                 
-                sdcard_message_t sd_msg;
-                sd_msg.command = SDCARD_CMD_LIST_IMAGES;
-                sd_msg.data.path[0] = '\0';  // Пустой путь = корневой каталог
-                xQueueSend(sdcard_queue, &sd_msg, portMAX_DELAY);
+                open_directory();
                 
                 // Переходим в состояние загрузки и ждем ответ
                 current_state = MENU_STATE_LOADING;
@@ -243,8 +344,8 @@ static void handle_ok_press(void) {
                         
                         snprintf(oled_msg.data.status.status_line1, 32, "%s %lu MB", 
                                 card_type_str, info->capacity_mb);
-                        snprintf(oled_msg.data.status.status_line2, 32, "%lu sectors", 
-                                info->sectors);
+                        snprintf(oled_msg.data.status.status_line2, 32, "Clock %lu.%lu MHz",
+                                info->clock_hz / 1000000, (info->clock_hz / 100000) % 10);
                     } else {
                         strcpy(oled_msg.data.status.status_line1, "Card Info");
                         strcpy(oled_msg.data.status.status_line2, "Not available");
@@ -255,11 +356,19 @@ static void handle_ok_press(void) {
                 }
                 
                 xQueueSend(oled_queue, &oled_msg, portMAX_DELAY);
+            } else if (selected_index == 2) {
+                // Тест скорости SD карты: результат выводит sdcard_task (UART и OLED)
+                printf("[MENU] Starting SD benchmark\n");
+                current_state = MENU_STATE_BENCHMARK;
+                
+                sdcard_message_t sd_msg;
+                sd_msg.command = SDCARD_CMD_BENCHMARK;
+                xQueueSend(sdcard_queue, &sd_msg, portMAX_DELAY);
             }
             break;
             
         case MENU_STATE_FILE_LIST:
-            if (file_count > 0) {
+            if (dir_requests == 0) {  // Пока страница читается, выбор недоступен
                 // Проверяем, выбран ли "< Back"
                 if (selected_index == 0) {
                     // Возврат в главное меню (или в родительский каталог)
@@ -285,15 +394,8 @@ static void handle_ok_press(void) {
                         printf("[MENU] Returning to: %s\n", current_path);
                         
                         // Запросить список файлов
-                        sdcard_message_t sd_msg;
-                        sd_msg.command = SDCARD_CMD_LIST_IMAGES;
-                        strncpy(sd_msg.data.path, current_path, sizeof(sd_msg.data.path) - 1);
-                        sd_msg.data.path[sizeof(sd_msg.data.path) - 1] = '\0';
-                        xQueueSend(sdcard_queue, &sd_msg, portMAX_DELAY);
-                        
+                        open_directory();
                         current_state = MENU_STATE_LOADING;
-                        selected_index = 0;
-                        scroll_offset = 0;
                         update_oled_menu();
                     } else {
                         // Возврат в главное меню
@@ -303,48 +405,37 @@ static void handle_ok_press(void) {
                     }
                 } else {
                     // Файл или каталог выбран
-                    printf("[MENU] File selected: %s\n", file_list[selected_index]);
+                    const sdcard_dir_entry_t *entry = dir_entry(selected_index);
+                    if (entry == NULL) {
+                        break;
+                    }
+                    printf("[MENU] File selected: %s\n", entry->name);
                     
-                    // Проверка, это каталог или файл
-                    if (file_list[selected_index][0] == '[') {
+                    if (entry->is_dir) {
                         // Это каталог - входим в него
-                        char dirname[32];
-                        int len = strlen(file_list[selected_index]);
-                        // Извлечь имя каталога без скобок [dirname] -> dirname
-                        strncpy(dirname, file_list[selected_index] + 1, len - 2);
-                        dirname[len - 2] = '\0';
-                        
-                        printf("[MENU] Entering directory: %s\n", dirname);
-                        printf("[MENU] Current path before: %s\n", current_path);
+                        size_t path_len = strlen(current_path);
+                        if (path_len + 1 + strlen(entry->name) >= sizeof(current_path)) {
+                            printf("[MENU] Path too long, cannot enter %s\n", entry->name);
+                            break;
+                        }
                         
                         // Обновить путь
-                        if (strlen(current_path) > 1) {
+                        if (path_len > 1) {
                             strcat(current_path, "/");
                         }
-                        strcat(current_path, dirname);
+                        strcat(current_path, entry->name);
                         in_subdirectory = true;
                         
                         printf("[MENU] New path: %s\n", current_path);
                         
-                        // Очистить старый список файлов
-                        file_count = 0;
-                        
                         // Запросить список файлов в подкаталоге
-                        sdcard_message_t sd_msg;
-                        sd_msg.command = SDCARD_CMD_LIST_IMAGES;
-                        strncpy(sd_msg.data.path, current_path, sizeof(sd_msg.data.path) - 1);
-                        sd_msg.data.path[sizeof(sd_msg.data.path) - 1] = '\0';
-                        xQueueSend(sdcard_queue, &sd_msg, portMAX_DELAY);
-                        
-                        printf("[MENU] Switching to LOADING state\n");
-                        
-                        // Переход в состояние загрузки
+                        open_directory();
                         current_state = MENU_STATE_LOADING;
-                        selected_index = 0;
-                        scroll_offset = 0;
                         update_oled_menu();
                     } else {
                         // Это файл образа
+                        strncpy(selected_name, entry->name, sizeof(selected_name) - 1);
+                        selected_name[sizeof(selected_name) - 1] = '\0';
                         selected_file_index = selected_index;
                         confirm_choice = 0;  // По умолчанию Yes
                         current_state = MENU_STATE_FILE_CONFIRM;
@@ -358,18 +449,25 @@ static void handle_ok_press(void) {
             // Проверка выбора пользователя
             if (confirm_choice == 0) {
                 // Yes - загрузка образа в эмулятор
-                printf("[MENU] Loading image: %s\n", file_list[selected_file_index]);
+                printf("[MENU] Loading image: %s\n", selected_name);
                 current_state = MENU_STATE_LOADING;
                 update_oled_menu();
                 
                 // Построить полный путь к файлу
-                char full_path[128];
+                char full_path[IMAGE_PATH_MAX];
+                int path_len;
                 if (in_subdirectory && strcmp(current_path, "/") != 0) {
                     // Файл в подкаталоге
-                    snprintf(full_path, sizeof(full_path), "%s/%s", current_path, file_list[selected_file_index]);
+                    path_len = snprintf(full_path, sizeof(full_path), "%s/%s", current_path, selected_name);
                 } else {
                     // Файл в корне
-                    snprintf(full_path, sizeof(full_path), "/%s", file_list[selected_file_index]);
+                    path_len = snprintf(full_path, sizeof(full_path), "/%s", selected_name);
+                }
+                if (path_len >= (int)sizeof(full_path)) {
+                    printf("[MENU] Path too long: %s/%s\n", current_path, selected_name);
+                    current_state = MENU_STATE_ERROR;
+                    update_oled_menu();
+                    break;
                 }
                 
                 printf("[MENU] Full path: %s\n", full_path);
@@ -377,7 +475,7 @@ static void handle_ok_press(void) {
                 // Отправить команду на загрузку образа в floppy эмулятор
                 floppy_message_t floppy_msg;
                 floppy_msg.command = FLOPPY_CMD_LOAD_IMAGE;
-                strncpy(floppy_msg.data.filename, full_path, 64);
+                strcpy(floppy_msg.data.filename, full_path);
                 xQueueSend(floppy_queue, &floppy_msg, portMAX_DELAY);
                 
                 // Ждем пока загрузится (floppy_emu покажет прогресс)
@@ -387,13 +485,8 @@ static void handle_ok_press(void) {
                 // No - вернуться в список файлов
                 printf("[MENU] Load cancelled\n");
                 current_state = MENU_STATE_FILE_LIST;
+                // Прокрутка и страница списка не менялись на экране подтверждения
                 selected_index = selected_file_index;
-                // Восстановить прокрутку
-                if (selected_index >= MENU_ITEMS_PER_PAGE) {
-                    scroll_offset = selected_index - MENU_ITEMS_PER_PAGE + 1;
-                } else {
-                    scroll_offset = 0;
-                }
                 update_oled_menu();
             }
             break;
@@ -421,7 +514,6 @@ static void handle_ok_press(void) {
                 // Сбросить состояние навигации
                 strcpy(current_path, "/");
                 in_subdirectory = false;
-                file_count = 0;
                 
                 // Вернуться в главное меню
                 current_state = MENU_STATE_MAIN;
@@ -437,6 +529,7 @@ static void handle_ok_press(void) {
             break;
             
         case MENU_STATE_SD_INFO:
+        case MENU_STATE_BENCHMARK:
             // Возврат в главное меню
             current_state = MENU_STATE_MAIN;
             selected_index = 0;
@@ -469,7 +562,6 @@ static void handle_back_press(void) {
             // Сбросить состояние навигации
             strcpy(current_path, "/");
             in_subdirectory = false;
-            file_count = 0;
             
             current_state = MENU_STATE_MAIN;
             selected_index = 0;
@@ -480,17 +572,13 @@ static void handle_back_press(void) {
         case MENU_STATE_FILE_CONFIRM:
             // Из подтверждения обратно в список файлов
             current_state = MENU_STATE_FILE_LIST;
+            // Прокрутка и страница списка не менялись на экране подтверждения
             selected_index = selected_file_index;
-            // Восстановить прокрутку
-            if (selected_index >= MENU_ITEMS_PER_PAGE) {
-                scroll_offset = selected_index - MENU_ITEMS_PER_PAGE + 1;
-            } else {
-                scroll_offset = 0;
-            }
             update_oled_menu();
             break;
             
         case MENU_STATE_SD_INFO:
+        case MENU_STATE_BENCHMARK:
         case MENU_STATE_ERROR:
             // Из информации/ошибки в главное меню
             current_state = MENU_STATE_MAIN;
@@ -519,52 +607,39 @@ void menu_task(void *pvParameters) {
     update_oled_menu();
     
     while (1) {
-        // Проверка ответов от SD карты
+        // Проверка ответов от SD карты: страница списка уже в dir_page
         sdcard_response_t sd_response;
-        if (xQueueReceive(sdcard_response_queue, &sd_response, 0) == pdTRUE) {
-            printf("[MENU] Received SD card response\n");
-            
-            if (current_state == MENU_STATE_LOADING) {
-                printf("[MENU] SD response: success=%d, count=%d\n", 
-                       sd_response.success, sd_response.data.file_list.count);
+        if (xQueueReceive(sdcard_response_queue, &sd_response, 0) == pdTRUE && dir_requests > 0) {
+            // Пока есть более новый запрос, dir_page перезаписывается - ждем его ответа
+            if (--dir_requests == 0) {
+                printf("[MENU] SD response: success=%d, entries %u+%u%s\n",
+                       sd_response.success, dir_page.offset, dir_page.count,
+                       dir_page.end ? " (end)" : "");
                 
-                if (sd_response.success && sd_response.data.file_list.count > 0) {
-                    // Получен список файлов
-                    // Сдвинем массив на 1 чтобы освободить место для "< Back"
-                    file_count = sd_response.data.file_list.count + 1;  // +1 для "< Back"
-                    
-                    // Первый элемент - "< Back"
-                    strcpy(file_list[0], "< Back");
-                    
-                    // Остальные - файлы с SD карты
-                    for (uint8_t i = 0; i < sd_response.data.file_list.count && i < (MAX_IMAGES - 1); i++) {
-                        strncpy(file_list[i + 1], sd_response.data.file_list.files[i], 31);
-                        file_list[i + 1][31] = '\0';
-                    }
-                    
-                    printf("[MENU] Loaded %d files from SD card (+ Back button)\n", file_count - 1);
-                    
-                    current_state = MENU_STATE_FILE_LIST;
-                    selected_index = 0;
-                    scroll_offset = 0;
-                    update_oled_menu();
-                } else if (sd_response.success && sd_response.data.file_list.count == 0) {
-                    // Нет файлов, но SD карта работает
-                    printf("[MENU] No .img files found in root directory\n");
-                    
-                    // Показать сообщение вместо ошибки
-                    file_count = 1;
-                    strcpy(file_list[0], "< Back");
-                    
-                    current_state = MENU_STATE_FILE_LIST;
-                    selected_index = 0;
-                    scroll_offset = 0;
-                    update_oled_menu();
-                } else {
+                bool listing = (current_state == MENU_STATE_LOADING ||
+                                current_state == MENU_STATE_FILE_LIST);
+                if (!listing) {
+                    // Список уже закрыт (длительное нажатие) - ответ не нужен
+                } else if (!sd_response.success) {
                     // Ошибка SD карты
                     printf("[MENU] SD card error\n");
                     current_state = MENU_STATE_ERROR;
                     update_oled_menu();
+                } else {
+                    // Конец каталога: выбор не дальше последней записи
+                    if (dir_page.end) {
+                        dir_end_known = true;
+                        dir_total = dir_page.offset + dir_page.count;
+                        if (selected_index > dir_total) {
+                            selected_index = dir_total;
+                        }
+                        if (scroll_offset > selected_index) {
+                            scroll_offset = selected_index;
+                        }
+                    }
+                    
+                    current_state = MENU_STATE_FILE_LIST;
+                    update_oled_menu();
                 }
             }
         }
@@ -574,7 +649,8 @@ void menu_task(void *pvParameters) {
             printf("[MENU] Received event: %d\n", msg.event);
             
             // Любое нажатие кнопки убирает экран информации о SD карте при старте
-            if (current_state == MENU_STATE_SD_INFO) {
+            // и результаты теста скорости
+            if (current_state == MENU_STATE_SD_INFO || current_state == MENU_STATE_BENCHMARK) {
                 current_state = MENU_STATE_MAIN;
                 selected_index = 0;
                 update_oled_menu();
@@ -14,6 +14,7 @@ typedef enum {
     MENU_STATE_LOADING,       // Загрузка образа
     MENU_STATE_DISK_LOADED,   // Диск загружен - Eject Yes/No
     MENU_STATE_SD_INFO,       // Информация о SD карте
+    MENU_STATE_BENCHMARK,     // Тест скорости SD карты (результат на экране)
     MENU_STATE_ERROR          // Ошибка
 } menu_state_t;
 
@@ -1,4 +1,5 @@
 #include "sdcard_task.h"
+#include "floppy_emu_task.h"
 #include "oled_task.h"
 #include "usb_task.h"
 #include "config.h"
@@ -7,6 +8,7 @@
 #include "pico/stdlib.h"
 #include "hardware/spi.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>  // для strcasecmp
 
@@ -18,10 +20,246 @@ QueueHandle_t sdcard_response_queue = NULL;
 static bool card_initialized = false;
 static FATFS fatfs;
 static bool fs_mounted = false;
-static char current_image[64] = "";
+static char current_image[IMAGE_PATH_MAX] = "";
 static bool image_loaded = false;
 static FIL current_file;
 static bool file_opened = false;
+static TaskHandle_t sdcard_task_handle = NULL;
+
+// Курсор постраничного списка: открытый каталог и номер следующей
+// показываемой записи (следующая страница продолжает чтение с него)
+static DIR list_dir;
+static bool list_open = false;
+static char list_path[IMAGE_PATH_MAX];
+static uint16_t list_next = 0;
+
+// Последняя инициализированная карта: по CID узнается та же карта после извлечения
+static uint8_t last_cid[16];
+static bool card_seen = false;
+
+// Образ на момент извлечения карты: размер и первый сектор на карте.
+// Та же карта могла быть изменена на другом устройстве
+static FSIZE_t removed_size = 0;
+static uint32_t removed_lba = 0;
+
+// Размещение образа на карте: серии кластеров (сектор образа -> LBA карты).
+// Чтение и запись образа идут напрямую в драйвер, FatFS - только для
+// секторов вне таблицы (образ сильнее фрагментирован, чем SDCARD_MAX_EXTENTS)
+typedef struct {
+    uint32_t sector;            // Первый сектор образа
+    uint32_t lba;               // Его сектор на карте
+    uint32_t count;             // Секторов подряд
+} sdcard_extent_t;
+
+static sdcard_extent_t extents[SDCARD_MAX_EXTENTS];
+static uint32_t extent_count = 0;
+static uint32_t extent_hint = 0;    // Последний найденный экстент (последовательный доступ)
+
+// Таблица цепочки кластеров FatFS (fast seek) открытого образа:
+// [размер таблицы] {кластеров, первый кластер}... [0]
+static DWORD image_clmt[SDCARD_CLMT_SIZE];
+
+/**
+ * @brief Включить fast seek для открытого образа
+ * @return false, если образ фрагментирован сильнее, чем помещается в таблицу
+ *         (f_lseek тогда идет по FAT, как без fast seek)
+ */
+static bool sdcard_create_clmt(void) {
+    image_clmt[0] = SDCARD_CLMT_SIZE;
+    current_file.cltbl = image_clmt;
+    
+    FRESULT res = f_lseek(&current_file, CREATE_LINKMAP);
+    if (res != FR_OK) {
+        if (res == FR_NOT_ENOUGH_CORE) {
+            printf("[SDCARD] Image needs a %lu-entry link map (have %d), seeking through FAT\n",
+                   image_clmt[0], SDCARD_CLMT_SIZE);
+        } else {
+            printf("[SDCARD] Link map error %d, seeking through FAT\n", res);
+        }
+        current_file.cltbl = NULL;
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Таблица экстентов из таблицы fast seek: каждый фрагмент - один экстент
+ */
+static void sdcard_extents_from_clmt(void) {
+    FATFS *fs = current_file.obj.fs;
+    uint32_t image_sectors = (uint32_t)((f_size(&current_file) + FLOPPY_SECTOR_SIZE - 1) / FLOPPY_SECTOR_SIZE);
+    uint32_t sector = 0;
+    
+    for (const DWORD *fragment = &image_clmt[1]; fragment[0] != 0 && sector < image_sectors; fragment += 2) {
+        if (extent_count == SDCARD_MAX_EXTENTS) {
+            printf("[SDCARD] Image has more than %d fragments, rest goes through FatFS\n",
+                   SDCARD_MAX_EXTENTS);
+            break;
+        }
+        
+        // Последний кластер может быть занят файлом частично
+        uint32_t count = fragment[0] * fs->csize;
+        if (count > image_sectors - sector) {
+            count = image_sectors - sector;
+        }
+        
+        extents[extent_count].sector = sector;
+        extents[extent_count].lba = fs->database + (fragment[1] - 2) * fs->csize;
+        extents[extent_count].count = count;
+        extent_count++;
+        sector += count;
+    }
+}
+
+/**
+ * @brief Таблица экстентов без fast seek: проход по цепочке кластеров
+ * 
+ * f_lseek на конец каждого кластера оставляет в current_file.clust этот
+ * кластер; граница сектора не требует чтения данных, а переход к следующему
+ * кластеру - одно чтение FAT (обычно из окна FatFS).
+ * При нехватке места таблица обрезается: остаток образа идет через FatFS.
+ */
+static void sdcard_extents_from_chain(void) {
+    FATFS *fs = current_file.obj.fs;
+    FSIZE_t size = f_size(&current_file);
+    FSIZE_t cluster_bytes = (FSIZE_t)fs->csize * FLOPPY_SECTOR_SIZE;
+    
+    for (FSIZE_t offset = 0; offset < size; offset += cluster_bytes) {
+        // Позиция в пределах файла: f_lseek за конец файла открытого на запись расширил бы его
+        FSIZE_t end = (size - offset > cluster_bytes) ? offset + cluster_bytes : size;
+        if (f_lseek(&current_file, end) != FR_OK || current_file.clust < 2) {
+            printf("[SDCARD] Cluster chain walk failed, image goes through FatFS\n");
+            extent_count = 0;
+            break;
+        }
+        
+        uint32_t sector = (uint32_t)(offset / FLOPPY_SECTOR_SIZE);
+        uint32_t lba = fs->database + (current_file.clust - 2) * fs->csize;
+        uint32_t count = (uint32_t)((end - offset + FLOPPY_SECTOR_SIZE - 1) / FLOPPY_SECTOR_SIZE);
+        
+        sdcard_extent_t *last = (extent_count > 0) ? &extents[extent_count - 1] : NULL;
+        if (last != NULL && last->lba + last->count == lba) {
+            last->count += count;
+        } else if (extent_count < SDCARD_MAX_EXTENTS) {
+            extents[extent_count].sector = sector;
+            extents[extent_count].lba = lba;
+            extents[extent_count].count = count;
+            extent_count++;
+        } else {
+            printf("[SDCARD] Image has more than %d fragments, rest goes through FatFS\n",
+                   SDCARD_MAX_EXTENTS);
+            break;
+        }
+    }
+    
+    f_lseek(&current_file, 0);
+}
+
+/**
+ * @brief Построить таблицу fast seek и таблицу экстентов открытого образа
+ */
+static void sdcard_build_extents(void) {
+    extent_count = 0;
+    extent_hint = 0;
+    
+    if (sdcard_create_clmt()) {
+        sdcard_extents_from_clmt();
+    } else {
+        sdcard_extents_from_chain();
+    }
+    
+    if (extent_count > 0) {
+        printf("[SDCARD] Image mapped to %lu extent(s), first at LBA %lu\n",
+               extent_count, extents[0].lba);
+    }
+}
+
+/**
+ * @brief Найти физическое размещение секторов образа
+ * @param lba Сектор карты для sector
+ * @param run Сколько секторов из count лежат на карте подряд
+ * @return false, если сектор вне таблицы экстентов
+ */
+static bool sdcard_map_sectors(uint32_t sector, uint32_t count, uint32_t *lba, uint32_t *run) {
+    for (uint32_t i = 0; i < extent_count; i++) {
+        uint32_t index = (extent_hint + i) % extent_count;
+        const sdcard_extent_t *extent = &extents[index];
+        
+        if (sector >= extent->sector && sector - extent->sector < extent->count) {
+            uint32_t offset = sector - extent->sector;
+            *lba = extent->lba + offset;
+            *run = (count < extent->count - offset) ? count : extent->count - offset;
+            extent_hint = index;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Первый сектор открытого образа на карте (0 - у файла нет кластеров)
+ */
+static uint32_t sdcard_image_lba(void) {
+    FATFS *fs = current_file.obj.fs;
+    if (current_file.obj.sclust < 2) {
+        return 0;
+    }
+    return fs->database + (current_file.obj.sclust - 2) * fs->csize;
+}
+
+/**
+ * @brief Открыть файл образа в current_file
+ */
+static bool sdcard_open_file(const char *filename) {
+    char filepath[IMAGE_PATH_MAX + 1];
+    snprintf(filepath, sizeof(filepath), "/%s", filename);
+    
+    // Образ открывается на запись, чтобы изменения хоста попадали на карту;
+    // файлы с атрибутом "только чтение" открываются только на чтение
+    FRESULT res = f_open(&current_file, filepath, FA_READ | FA_WRITE);
+    if (res == FR_DENIED) {
+        printf("[SDCARD] Image is read-only, opening without write access\n");
+        res = f_open(&current_file, filepath, FA_READ);
+    }
+    if (res != FR_OK) {
+        printf("[SDCARD] Failed to open file (error %d)\n", res);
+        return false;
+    }
+    
+    file_opened = true;
+    sdcard_build_extents();
+    return true;
+}
+
+/**
+ * @brief Восстановить загруженный образ после повторной установки карты
+ * @param same_card Вставлена та же карта (совпал CID)
+ */
+static void sdcard_restore_image(bool same_card) {
+    if (same_card && sdcard_open_file(current_image)) {
+        // Совпадения CID мало: образ могли перезаписать или пересоздать
+        // на другом устройстве, и тогда грязный кеш испортил бы чужие данные
+        if (f_size(&current_file) == removed_size && sdcard_image_lba() == removed_lba) {
+            printf("[SDCARD] Same card, image reopened: %s\n", current_image);
+            return;
+        }
+        printf("[SDCARD] Image size or location changed since removal\n");
+        f_close(&current_file);
+        file_opened = false;
+    }
+    
+    // Другая карта или образ пропал - кеш эмулятора больше не соответствует карте
+    printf("[SDCARD] Card changed, ejecting image: %s\n", current_image);
+    image_loaded = false;
+    current_image[0] = '\0';
+    
+    floppy_message_t msg;
+    msg.command = FLOPPY_CMD_EJECT_IMAGE;
+    if (floppy_queue != NULL) {
+        xQueueSend(floppy_queue, &msg, pdMS_TO_TICKS(100));
+    }
+}
 
 /**
  * @brief Инициализация SD карты и FatFS
@@ -29,13 +267,15 @@ static bool file_opened = false;
 static bool sdcard_init_card(void) {
     printf("[SDCARD] Initializing SD card...\n");
     
-    // Настройка SPI пинов
+#if SD_BACKEND == SD_BACKEND_SPI
+    // Настройка SPI пинов (в режиме SDIO это DAT0-DAT3 - их настраивает драйвер)
     gpio_set_function(SD_PIN_MISO, GPIO_FUNC_SPI);
     gpio_set_function(SD_PIN_SCK, GPIO_FUNC_SPI);
     gpio_set_function(SD_PIN_MOSI, GPIO_FUNC_SPI);
     
     printf("[SDCARD] SPI pins configured (MISO:%d SCK:%d MOSI:%d CS:%d)\n",
            SD_PIN_MISO, SD_PIN_SCK, SD_PIN_MOSI, SD_PIN_CS);
+#endif
     
     // Инициализация низкоуровневого драйвера
     if (!sd_card_init(SD_SPI_PORT, SD_PIN_CS)) {
@@ -71,6 +311,11 @@ static bool sdcard_init_card(void) {
     
     printf("[SDCARD] Card: %s\n", info_line1);
     printf("[SDCARD] %s\n", info_line2);
+    printf("[SDCARD] Bus clock: %lu kHz\n", info->clock_hz / 1000);
+    
+    bool same_card = card_seen && memcmp(last_cid, info->cid, sizeof(last_cid)) == 0;
+    memcpy(last_cid, info->cid, sizeof(last_cid));
+    card_seen = true;
     
     // Не показываем информацию автоматически при старте
     // Информация будет доступна через пункт меню "SD Card Info"
@@ -98,13 +343,55 @@ static bool sdcard_init_card(void) {
                total_sectors / 2, free_sectors / 2);
     }
     
+    // Карта вернулась после извлечения при загруженном образе
+    if (image_loaded && !file_opened) {
+        sdcard_restore_image(same_card);
+    }
+    
     return true;
 }
 
+/**
+ * @brief Карта извлечена: освободить FatFS и драйвер, сохранив имя образа
+ * @note Файл не закрывается через f_close() - писать уже некуда. Кеш эмулятора
+ *       сохраняется: та же карта вернется с тем же образом (sdcard_restore_image)
+ */
+static void sdcard_card_removed(void) {
+    printf("[SDCARD] Card removed\n");
+    
+    if (file_opened) {
+        removed_size = f_size(&current_file);
+        removed_lba = sdcard_image_lba();
+    }
+    file_opened = false;
+    list_open = false;
+    if (fs_mounted) {
+        f_mount(NULL, "0:", 0);
+        fs_mounted = false;
+    }
+    
+    sd_card_deinit();
+    card_initialized = false;
+}
+
+/**
+ * @brief Проверить наличие карты
+ * @note Без вывода CD инициализированная карта опрашивается CMD13,
+ *       а отсутствие неинициализированной выясняется попыткой инициализации
+ */
+static bool sdcard_card_present(void) {
+#if SD_PIN_CD >= 0
+    return gpio_get(SD_PIN_CD) == (SD_CD_ACTIVE_LOW ? 0 : 1);
+#else
+    return !card_initialized || sd_card_probe();
+#endif
+}
+
 /**
  * @brief Размонтирование файловой системы
  */
 static void sdcard_unmount(void) {
+    list_open = false;
     if (file_opened) {
         f_close(&current_file);
         file_opened = false;
@@ -120,83 +407,113 @@ static void sdcard_unmount(void) {
 }
 
 /**
- * @brief Получение списка .img файлов
+ * @brief Показывается ли запись в списке образов: каталоги и файлы .img
+ */
+static bool sdcard_list_visible(const FILINFO *fno) {
+    // Пропустить скрытые файлы и системные файлы
+    if (fno->fname[0] == '.' || (fno->fattrib & AM_HID) || (fno->fattrib & AM_SYS)) {
+        return false;
+    }
+    if (fno->fattrib & AM_DIR) {
+        return true;
+    }
+    
+    // Проверить расширение .img (без учета регистра)
+    size_t len = strlen(fno->fname);
+    size_t ext_len = strlen(IMAGE_EXTENSION);
+    return len > ext_len && strcasecmp(fno->fname + len - ext_len, IMAGE_EXTENSION) == 0;
+}
+
+/**
+ * @brief Закрыть курсор списка (смена каталога, карты или содержимого)
+ */
+static void sdcard_list_close(void) {
+    if (list_open) {
+        f_closedir(&list_dir);
+        list_open = false;
+    }
+}
+
+/**
+ * @brief Страница списка образов и каталогов
  * @param path Путь к каталогу (например "/" или "/subdir")
+ * @param offset Номер первой записи среди показываемых
+ * @param count Записей в странице (не больше SDCARD_LIST_PAGE_MAX)
+ * @param page Страница запросившего; ответ в sdcard_response_queue
+ * 
+ * Каталог остается открытым между запросами: следующая страница
+ * продолжает чтение с курсора, возврат назад перечитывает каталог
+ * с начала. Размер каталога не ограничен, в RAM - только страница.
  */
-static void sdcard_list_images(const char *path) {
-    printf("[SDCARD] Listing .img files in: %s\n", path);
+static void sdcard_list_images(const char *path, uint16_t offset, uint8_t count,
+                               sdcard_dir_page_t *page) {
+    sdcard_response_t response;
+    response.success = false;
+    response.page = page;
+    
+    page->offset = offset;
+    page->count = 0;
+    page->end = true;
+    if (count > SDCARD_LIST_PAGE_MAX) {
+        count = SDCARD_LIST_PAGE_MAX;
+    }
     
     if (!card_initialized || !fs_mounted) {
         printf("[SDCARD] Card not initialized!\n");
-        
-        sdcard_response_t response;
-        response.success = false;
-        response.data.file_list.count = 0;
         xQueueSend(sdcard_response_queue, &response, portMAX_DELAY);
         return;
     }
     
-    sdcard_response_t response;
-    response.success = true;
-    response.data.file_list.count = 0;
+    if (!list_open || strcmp(list_path, path) != 0 || offset < list_next) {
+        sdcard_list_close();
+        
+        FRESULT res = f_opendir(&list_dir, path);
+        if (res != FR_OK) {
+            printf("[SDCARD] Failed to open directory %s (error %d)\n", path, res);
+            xQueueSend(sdcard_response_queue, &response, portMAX_DELAY);
+            return;
+        }
+        
+        list_open = true;
+        strncpy(list_path, path, sizeof(list_path) - 1);
+        list_path[sizeof(list_path) - 1] = '\0';
+        list_next = 0;
+    }
     
-    DIR dir;
     FILINFO fno;
-    FRESULT res;
+    page->end = false;
     
-    // Открыть указанную директорию
-    res = f_opendir(&dir, path);
-    if (res != FR_OK) {
-        printf("[SDCARD] Failed to open directory %s (error %d)\n", path, res);
-        response.success = false;
-        xQueueSend(sdcard_response_queue, &response, portMAX_DELAY);
-        return;
-    }
-    
-    // Перебрать все файлы и каталоги
-    while (response.data.file_list.count < 32) {  // Максимум 32 файла из sdcard_task.h
-        res = f_readdir(&dir, &fno);
-        if (res != FR_OK || fno.fname[0] == 0) {
-            break;  // Ошибка или конец директории
+    while (page->count < count) {
+        FRESULT res = f_readdir(&list_dir, &fno);
+        if (res != FR_OK) {
+            printf("[SDCARD] Directory read error %d in %s\n", res, path);
+            sdcard_list_close();
+            xQueueSend(sdcard_response_queue, &response, portMAX_DELAY);
+            return;
         }
-        
-        // Пропустить скрытые файлы и системные файлы
-        if (fno.fname[0] == '.' || (fno.fattrib & AM_HID) || (fno.fattrib & AM_SYS)) {
-            continue;
+        if (fno.fname[0] == 0) {
+            page->end = true;
+            break;
         }
         
-        // Если это каталог - добавить с префиксом [DIR]
-        if (fno.fattrib & AM_DIR) {
-            // Добавить каталог в список с префиксом
-            snprintf(response.data.file_list.files[response.data.file_list.count],
-                    32, "[%s]", fno.fname);
-            response.data.file_list.files[response.data.file_list.count][31] = '\0';
-            
-            printf("[SDCARD] Found directory: %s\n", fno.fname);
-            response.data.file_list.count++;
+        // Записи до offset только пропускаются
+        if (!sdcard_list_visible(&fno) || list_next++ < offset) {
             continue;
         }
         
-        // Проверить расширение .img (без учета регистра)
-        size_t len = strlen(fno.fname);
-        if (len > 4) {
-            const char* ext = fno.fname + len - 4;
-            if (strcasecmp(ext, ".img") == 0) {
-                // Добавить в список
-                strncpy(response.data.file_list.files[response.data.file_list.count],
-                       fno.fname,
-                       31);  // Максимум 32 символа (из sdcard_task.h)
-                response.data.file_list.files[response.data.file_list.count][31] = '\0';
-                
-                printf("[SDCARD] Found: %s (%lu bytes)\n", fno.fname, fno.fsize);
-                response.data.file_list.count++;
-            }
-        }
+        // Длинное имя, не помещающееся в запись, заменяется коротким -
+        // путь по нему открывает тот же файл
+        sdcard_dir_entry_t *entry = &page->entries[page->count++];
+        const char *name = (strlen(fno.fname) < sizeof(entry->name)) ? fno.fname : fno.altname;
+        strncpy(entry->name, name, sizeof(entry->name) - 1);
+        entry->name[sizeof(entry->name) - 1] = '\0';
+        entry->is_dir = (fno.fattrib & AM_DIR) != 0;
+        entry->size = (uint32_t)fno.fsize;
     }
     
-    f_closedir(&dir);
-    
-    printf("[SDCARD] Found %d image files\n", response.data.file_list.count);
+    response.success = true;
+    printf("[SDCARD] %s: entries %u-%u%s\n", path, offset, offset + page->count,
+           page->end ? " (end)" : "");
     
     // Отправка ответа
     xQueueSend(sdcard_response_queue, &response, portMAX_DELAY);
@@ -213,24 +530,18 @@ static void sdcard_load_image(const char *filename) {
         return;
     }
     
-    // Закрыть предыдущий файл, если открыт
+    // Закрыть предыдущий файл, если открыт (f_close синхронизирует только
+    // записи через FatFS, записи по экстентам - sd_card_sync())
     if (file_opened) {
+        sd_card_sync();
         f_close(&current_file);
         file_opened = false;
     }
     
-    // Открыть файл образа
-    char filepath[64];
-    snprintf(filepath, sizeof(filepath), "/%s", filename);
-    
-    FRESULT res = f_open(&current_file, filepath, FA_READ);
-    if (res != FR_OK) {
-        printf("[SDCARD] Failed to open file (error %d)\n", res);
+    if (!sdcard_open_file(filename)) {
         return;
     }
     
-    file_opened = true;
-    
     // Проверить размер файла
     FSIZE_t file_size = f_size(&current_file);
     printf("[SDCARD] File size: %lu bytes\n", (unsigned long)file_size);
@@ -259,34 +570,258 @@ static void sdcard_load_image(const char *filename) {
     */
 }
 
+// Параметры BPB стандартных форматов для новых образов (как у DOS FORMAT)
+typedef struct {
+    floppy_type_t type;
+    uint8_t  sectors_per_cluster;
+    uint16_t root_entries;
+    uint8_t  media;             // Дескриптор носителя (BPB и первый байт FAT)
+    uint16_t fat_size;          // Секторов в одной копии FAT
+    uint16_t sectors_per_track;
+    uint8_t  heads;
+} sdcard_format_t;
+
+static const sdcard_format_t image_formats[] = {
+    { FLOPPY_TYPE_160K,  1, 64,  0xFE, 1, 8,  1 },
+    { FLOPPY_TYPE_180K,  1, 64,  0xFC, 2, 9,  1 },
+    { FLOPPY_TYPE_320K,  2, 112, 0xFF, 1, 8,  2 },
+    { FLOPPY_TYPE_360K,  2, 112, 0xFD, 2, 9,  2 },
+    { FLOPPY_TYPE_720K,  2, 112, 0xF9, 3, 9,  2 },
+    { FLOPPY_TYPE_1200K, 1, 224, 0xF9, 7, 15, 2 },
+    { FLOPPY_TYPE_1440K, 1, 224, 0xF0, 9, 18, 2 }
+};
+
+#define IMAGE_FORMAT_COUNT  (sizeof(image_formats) / sizeof(image_formats[0]))
+#define IMAGE_FAT_COPIES    2
+
+static inline void put_le16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
 /**
- * @brief Чтение сектора из текущего образа
+ * @brief Размер служебной области формата: boot + FATs + корневой каталог
  */
-bool sdcard_read_sector(uint32_t sector, uint8_t *buffer) {
+static inline uint32_t image_meta_sectors(const sdcard_format_t *format) {
+    return 1 + IMAGE_FAT_COPIES * format->fat_size +
+           (format->root_entries * 32u) / FLOPPY_SECTOR_SIZE;
+}
+
+/**
+ * @brief Служебная область чистой FAT12 дискеты
+ * @param meta Буфер на image_meta_sectors() секторов (заполняется целиком)
+ */
+static void sdcard_format_meta(uint8_t *meta, const floppy_geometry_t *geometry,
+                               const sdcard_format_t *format) {
+    memset(meta, 0, image_meta_sectors(format) * FLOPPY_SECTOR_SIZE);
+    
+    uint8_t *boot = meta;
+    boot[0] = 0xEB;                         // JMP SHORT на код загрузчика
+    boot[1] = 0x3C;
+    boot[2] = 0x90;
+    memcpy(&boot[3], "MSDOS5.0", 8);
+    put_le16(&boot[11], FLOPPY_SECTOR_SIZE);
+    boot[13] = format->sectors_per_cluster;
+    put_le16(&boot[14], 1);                 // Зарезервированных секторов
+    boot[16] = IMAGE_FAT_COPIES;
+    put_le16(&boot[17], format->root_entries);
+    put_le16(&boot[19], (uint16_t)geometry->sectors);
+    boot[21] = format->media;
+    put_le16(&boot[22], format->fat_size);
+    put_le16(&boot[24], format->sectors_per_track);
+    put_le16(&boot[26], format->heads);
+    
+    // Расширенный BPB: серийный номер тома из таймера
+    uint32_t serial = time_us_32();
+    boot[38] = 0x29;
+    put_le16(&boot[39], (uint16_t)serial);
+    put_le16(&boot[41], (uint16_t)(serial >> 16));
+    memcpy(&boot[43], "NO NAME    ", 11);
+    memcpy(&boot[54], "FAT12   ", 8);
+    
+    // Код загрузчика: INT 18h - диск не системный, BIOS пробует следующее устройство
+    boot[62] = 0xCD;
+    boot[63] = 0x18;
+    boot[510] = 0x55;
+    boot[511] = 0xAA;
+    
+    // Записи 0 и 1 каждой копии FAT: дескриптор носителя и конец цепочки
+    for (uint32_t copy = 0; copy < IMAGE_FAT_COPIES; copy++) {
+        uint8_t *fat = meta + (1 + copy * format->fat_size) * FLOPPY_SECTOR_SIZE;
+        fat[0] = format->media;
+        fat[1] = 0xFF;
+        fat[2] = 0xFF;
+    }
+}
+
+/**
+ * @brief Создать чистый образ одним непрерывным фрагментом
+ * 
+ * f_expand выделяет кластеры подряд, поэтому таблица экстентов образа
+ * сводится к одному смещению. Служебная область собирается в RAM и уходит
+ * на карту одной многоблочной записью мимо FatFS; область данных не
+ * очищается - по FAT она свободна.
+ */
+static void sdcard_create_image(const char *filename, floppy_type_t type) {
+    if (!card_initialized || !fs_mounted) {
+        printf("[SDCARD] Card not initialized!\n");
+        return;
+    }
+    
+    const floppy_geometry_t *geometry = NULL;
+    const sdcard_format_t *format = NULL;
+    for (uint32_t i = 0; i < FLOPPY_FORMAT_COUNT; i++) {
+        if (floppy_formats[i].type == type) {
+            geometry = &floppy_formats[i];
+        }
+    }
+    for (uint32_t i = 0; i < IMAGE_FORMAT_COUNT; i++) {
+        if (image_formats[i].type == type) {
+            format = &image_formats[i];
+        }
+    }
+    if (geometry == NULL || format == NULL) {
+        printf("[SDCARD] Unknown image format %d\n", type);
+        return;
+    }
+    
+    // Путь должен помещаться в IMAGE_PATH_MAX, иначе образ нельзя будет загрузить
+    char filepath[IMAGE_PATH_MAX];
+    int length = snprintf(filepath, sizeof(filepath), "/%s", filename);
+    if (length < 0 || (size_t)length >= sizeof(filepath)) {
+        printf("[SDCARD] Image name too long: %s\n", filename);
+        return;
+    }
+    
+    // Новая запись каталога сдвигает номера в списке: курсор читается заново
+    sdcard_list_close();
+    
+    uint32_t meta_sectors = image_meta_sectors(format);
+    uint8_t *meta = pvPortMalloc(meta_sectors * FLOPPY_SECTOR_SIZE);
+    FIL *file = pvPortMalloc(sizeof(FIL));
+    if (meta == NULL || file == NULL) {
+        printf("[SDCARD] Out of memory\n");
+        vPortFree(meta);
+        vPortFree(file);
+        return;
+    }
+    
+    FSIZE_t size = (FSIZE_t)geometry->sectors * FLOPPY_SECTOR_SIZE;
+    bool ok = false;
+    
+    FRESULT res = f_open(file, filepath, FA_CREATE_NEW | FA_WRITE);
+    if (res == FR_EXIST) {
+        printf("[SDCARD] %s already exists\n", filename);
+    } else if (res != FR_OK) {
+        printf("[SDCARD] Failed to create %s (error %d)\n", filename, res);
+    } else {
+        res = f_expand(file, size, 1);
+        if (res == FR_DENIED) {
+            printf("[SDCARD] No contiguous %lu KB of free space for %s\n",
+                   (uint32_t)(size / 1024), filename);
+        } else if (res != FR_OK) {
+            printf("[SDCARD] Allocation error %d\n", res);
+        } else {
+            FATFS *fs = file->obj.fs;
+            uint32_t lba = fs->database + (file->obj.sclust - 2) * fs->csize;
+            sdcard_format_meta(meta, geometry, format);
+            
+            // Данные до записи каталога: после сбоя на карте нет полуготового образа
+            ok = sd_card_write_blocks(lba, meta_sectors, meta) && sd_card_sync();
+            if (!ok) {
+                printf("[SDCARD] Failed to write FAT12 metadata at LBA %lu\n", lba);
+            }
+        }
+        
+        res = f_close(file);
+        if (ok && res != FR_OK) {
+            printf("[SDCARD] Failed to close %s (error %d)\n", filename, res);
+            ok = false;
+        }
+        if (!ok) {
+            f_unlink(filepath);
+        }
+    }
+    
+    if (ok) {
+        printf("[SDCARD] Created %s: %s FAT12, %lu sectors, contiguous\n",
+               filename, geometry->name, geometry->sectors);
+    }
+    
+    vPortFree(meta);
+    vPortFree(file);
+}
+
+/**
+ * @brief Проверить, что диапазон секторов лежит в открытом образе
+ */
+static bool sdcard_check_range(uint32_t sector, uint32_t count) {
     if (!file_opened || !image_loaded) {
-        printf("[SDCARD] No image loaded! (file_opened=%d, image_loaded=%d)\n", 
+        printf("[SDCARD] No image loaded! (file_opened=%d, image_loaded=%d)\n",
                file_opened, image_loaded);
         return false;
     }
     
-    if (sector >= FLOPPY_TOTAL_SECTORS) {
-        printf("[SDCARD] Invalid sector: %lu\n", sector);
+    if (count == 0 || sector + count > FLOPPY_TOTAL_SECTORS) {
+        printf("[SDCARD] Invalid sector range: %lu+%lu\n", sector, count);
         return false;
     }
     
-    // Перемещение к нужному сектору
-    FSIZE_t offset = sector * FLOPPY_SECTOR_SIZE;
+    return true;
+}
+
+/**
+ * @brief Установить позицию файла на сектор
+ * @note Если позиция уже там (соседний запрос), f_lseek не вызывается -
+ *       FatFS продолжает текущую многоблочную операцию с картой
+ */
+static bool sdcard_seek(uint32_t sector) {
+    FSIZE_t offset = (FSIZE_t)sector * FLOPPY_SECTOR_SIZE;
+    if (f_tell(&current_file) == offset) {
+        return true;
+    }
+    
     FRESULT res = f_lseek(&current_file, offset);
     if (res != FR_OK) {
         printf("[SDCARD] Seek error %d at sector %lu\n", res, sector);
         return false;
     }
+    return true;
+}
+
+/**
+ * @brief Чтение секторов образа (только в задаче SDCARD)
+ * @note Секторы из таблицы экстентов читаются драйвером напрямую (для
+ *       непрерывного образа - одно сложение на запрос), остальные - FatFS
+ */
+static bool sdcard_do_read(uint32_t sector, uint32_t count, uint8_t *buffer) {
+    if (!sdcard_check_range(sector, count)) {
+        return false;
+    }
+    
+    uint32_t lba, run;
+    while (count > 0 && sdcard_map_sectors(sector, count, &lba, &run)) {
+        if (!sd_card_read_blocks(lba, run, buffer)) {
+            printf("[SDCARD] Read error at sector %lu (LBA %lu)\n", sector, lba);
+            return false;
+        }
+        sector += run;
+        count -= run;
+        buffer += run * FLOPPY_SECTOR_SIZE;
+    }
+    if (count == 0) {
+        return true;
+    }
+    
+    if (!sdcard_seek(sector)) {
+        return false;
+    }
     
-    // Чтение сектора
+    UINT bytes = count * FLOPPY_SECTOR_SIZE;
     UINT bytes_read;
-    res = f_read(&current_file, buffer, FLOPPY_SECTOR_SIZE, &bytes_read);
-    if (res != FR_OK || bytes_read != FLOPPY_SECTOR_SIZE) {
-        printf("[SDCARD] Read error %d (read %u bytes) at sector %lu\n", res, bytes_read, sector);
+    FRESULT res = f_read(&current_file, buffer, bytes, &bytes_read);
+    if (res != FR_OK || bytes_read != bytes) {
+        printf("[SDCARD] Read error %d (read %u of %u bytes) at sector %lu\n", res, bytes_read, bytes, sector);
         return false;
     }
     
@@ -294,41 +829,242 @@ bool sdcard_read_sector(uint32_t sector, uint8_t *buffer) {
 }
 
 /**
- * @brief Запись сектора в текущий образ
+ * @brief Запись секторов образа без синхронизации (только в задаче SDCARD)
  */
-bool sdcard_write_sector(uint32_t sector, const uint8_t *buffer) {
-    if (!file_opened || !image_loaded) {
-        printf("[SDCARD] No image loaded!\n");
+static bool sdcard_do_write(uint32_t sector, uint32_t count, const uint8_t *buffer) {
+    if (!sdcard_check_range(sector, count)) {
         return false;
     }
     
-    if (sector >= FLOPPY_TOTAL_SECTORS) {
-        printf("[SDCARD] Invalid sector: %lu\n", sector);
+    // Запись мимо FatFS не должна обходить атрибут "только чтение"
+    if (!(current_file.flag & FA_WRITE)) {
+        printf("[SDCARD] Image is read-only\n");
         return false;
     }
     
-    // Перемещение к нужному сектору
-    FSIZE_t offset = sector * FLOPPY_SECTOR_SIZE;
-    FRESULT res = f_lseek(&current_file, offset);
-    if (res != FR_OK) {
-        printf("[SDCARD] Seek error %d\n", res);
+    // Соседние записи продолжают одну многоблочную запись драйвера до sdcard_do_sync()
+    uint32_t lba, run;
+    while (count > 0 && sdcard_map_sectors(sector, count, &lba, &run)) {
+        if (!sd_card_write_stream(lba, run, buffer)) {
+            printf("[SDCARD] Write error at sector %lu (LBA %lu)\n", sector, lba);
+            return false;
+        }
+        sector += run;
+        count -= run;
+        buffer += run * FLOPPY_SECTOR_SIZE;
+    }
+    if (count == 0) {
+        return true;
+    }
+    
+    if (!sdcard_seek(sector)) {
         return false;
     }
     
-    // Запись сектора
+    UINT bytes = count * FLOPPY_SECTOR_SIZE;
     UINT bytes_written;
-    res = f_write(&current_file, buffer, FLOPPY_SECTOR_SIZE, &bytes_written);
-    if (res != FR_OK || bytes_written != FLOPPY_SECTOR_SIZE) {
-        printf("[SDCARD] Write error %d (wrote %u bytes)\n", res, bytes_written);
+    FRESULT res = f_write(&current_file, buffer, bytes, &bytes_written);
+    if (res != FR_OK || bytes_written != bytes) {
+        printf("[SDCARD] Write error %d (wrote %u of %u bytes)\n", res, bytes_written, bytes);
         return false;
     }
     
-    // Синхронизация для надежности
-    f_sync(&current_file);
+    return true;
+}
+
+/**
+ * @brief Синхронизация образа (только в задаче SDCARD)
+ */
+static bool sdcard_do_sync(void) {
+    if (!file_opened) {
+        return false;
+    }
+    
+    // Записи через FatFS (FAT, запись каталога, CTRL_SYNC)
+    FRESULT res = f_sync(&current_file);
+    if (res != FR_OK) {
+        printf("[SDCARD] Sync error %d\n", res);
+        return false;
+    }
+    
+    // Записи по таблице экстентов идут мимо FatFS: закрыть многоблочную
+    // запись драйвера и проверить статус карты
+    if (!sd_card_sync()) {
+        printf("[SDCARD] Sync error: card reported a write failure\n");
+        return false;
+    }
     
     return true;
 }
 
+/**
+ * @brief Завершить запрос: выставить состояние, вызвать callback, уведомить отправителя
+ */
+static void sdcard_io_complete(sdcard_io_request_t *req, bool ok) {
+    TaskHandle_t notify_task = req->notify_task;
+    
+    req->state = ok ? SDCARD_IO_DONE : SDCARD_IO_FAILED;
+    if (req->callback != NULL) {
+        req->callback(req);
+    }
+    
+    // После state/callback запрос может быть уже освобожден отправителем
+    if (notify_task != NULL) {
+        xTaskNotifyGiveIndexed(notify_task, SDCARD_IO_NOTIFY_INDEX);
+    }
+}
+
+/**
+ * @brief Можно ли выполнить next одной операцией вместе с серией [first..last]
+ */
+static bool sdcard_io_mergeable(const sdcard_io_request_t *first, const sdcard_io_request_t *last,
+                                uint32_t sectors, const sdcard_io_request_t *next) {
+    if (next->op != first->op) {
+        return false;
+    }
+    if (next->op == SDCARD_IO_SYNC) {
+        return true;
+    }
+    return next->sector == first->sector + sectors &&
+           next->buffer == last->buffer + last->count * FLOPPY_SECTOR_SIZE;
+}
+
+/**
+ * @brief Выполнить запрос и соседние с ним запросы из очереди
+ * 
+ * Подряд идущие запросы одного типа на соседние секторы с продолжающимися
+ * буферами выполняются одним f_read/f_write, подряд идущие f_sync - одним.
+ * Соседние секторы с разными буферами идут без f_lseek, поэтому
+ * многоблочная операция с картой тоже не прерывается.
+ * @return false, если запросы завершились ошибкой
+ */
+static bool sdcard_process_io(sdcard_io_request_t *first) {
+    sdcard_io_request_t *batch[SDCARD_IO_MERGE_MAX];
+    uint32_t batch_count = 1;
+    uint32_t sectors = first->count;
+    batch[0] = first;
+    
+    sdcard_message_t next;
+    while (batch_count < SDCARD_IO_MERGE_MAX &&
+           xQueuePeek(sdcard_queue, &next, 0) == pdTRUE &&
+           next.command == SDCARD_CMD_IO &&
+           sdcard_io_mergeable(first, batch[batch_count - 1], sectors, next.data.io)) {
+        xQueueReceive(sdcard_queue, &next, 0);
+        batch[batch_count++] = next.data.io;
+        sectors += next.data.io->count;
+    }
+    
+    bool ok = false;
+    switch (first->op) {
+        case SDCARD_IO_READ:
+            ok = sdcard_do_read(first->sector, sectors, first->buffer);
+            break;
+        case SDCARD_IO_WRITE:
+            ok = sdcard_do_write(first->sector, sectors, first->buffer);
+            break;
+        case SDCARD_IO_SYNC:
+            ok = sdcard_do_sync();
+            break;
+    }
+    
+    for (uint32_t i = 0; i < batch_count; i++) {
+        sdcard_io_complete(batch[i], ok);
+    }
+    return ok;
+}
+
+/**
+ * @brief Поставить запрос в очередь задачи SDCARD (без ожидания выполнения)
+ * @return false, если очередь недоступна
+ */
+bool sdcard_submit_io(sdcard_io_request_t *req) {
+    if (sdcard_queue == NULL) {
+        return false;
+    }
+    
+    req->state = SDCARD_IO_PENDING;
+    
+    sdcard_message_t msg;
+    msg.command = SDCARD_CMD_IO;
+    msg.data.io = req;
+    return xQueueSend(sdcard_queue, &msg, portMAX_DELAY) == pdTRUE;
+}
+
+/**
+ * @brief Выполнить запрос и дождаться результата
+ * @note В самой задаче SDCARD выполняется сразу, иначе - через очередь,
+ *       поэтому карта и current_file используются только одной задачей
+ */
+static bool sdcard_io_sync(sdcard_io_op_t op, uint32_t sector, uint32_t count, uint8_t *buffer) {
+    if (xTaskGetCurrentTaskHandle() == sdcard_task_handle) {
+        switch (op) {
+            case SDCARD_IO_READ:  return sdcard_do_read(sector, count, buffer);
+            case SDCARD_IO_WRITE: return sdcard_do_write(sector, count, buffer);
+            default:              return sdcard_do_sync();
+        }
+    }
+    
+    sdcard_io_request_t req = {
+        .op = op,
+        .sector = sector,
+        .count = count,
+        .buffer = buffer,
+        .callback = NULL,
+        .notify_task = xTaskGetCurrentTaskHandle(),
+        .context = NULL
+    };
+    
+    if (!sdcard_submit_io(&req)) {
+        return false;
+    }
+    
+    // Лишние уведомления от прошлых запросов только повторяют проверку
+    while (req.state == SDCARD_IO_PENDING) {
+        ulTaskNotifyTakeIndexed(SDCARD_IO_NOTIFY_INDEX, pdTRUE, portMAX_DELAY);
+    }
+    
+    return req.state == SDCARD_IO_DONE;
+}
+
+/**
+ * @brief Чтение сектора из текущего образа
+ */
+bool sdcard_read_sector(uint32_t sector, uint8_t *buffer) {
+    return sdcard_io_sync(SDCARD_IO_READ, sector, 1, buffer);
+}
+
+/**
+ * @brief Чтение нескольких соседних секторов одной операцией
+ */
+bool sdcard_read_sectors(uint32_t sector, uint32_t count, uint8_t *buffer) {
+    return sdcard_io_sync(SDCARD_IO_READ, sector, count, buffer);
+}
+
+/**
+ * @brief Запись сектора в текущий образ (без синхронизации, см. sdcard_sync())
+ */
+bool sdcard_write_sector(uint32_t sector, const uint8_t *buffer) {
+    return sdcard_io_sync(SDCARD_IO_WRITE, sector, 1, (uint8_t *)buffer);
+}
+
+/**
+ * @brief Запись нескольких соседних секторов (без синхронизации)
+ * @note Запись, продолжающая предыдущую, идет без f_lseek - соседние
+ *       серии уходят на карту одной многоблочной записью до sdcard_sync()
+ */
+bool sdcard_write_sectors(uint32_t sector, uint32_t count, const uint8_t *buffer) {
+    return sdcard_io_sync(SDCARD_IO_WRITE, sector, count, (uint8_t *)buffer);
+}
+
+/**
+ * @brief Барьер записи: все записанное ранее попадает на карту
+ * @note Вызывается в точках сброса (SYNCHRONIZE CACHE, извлечение, простой),
+ *       а не после каждой записи
+ */
+bool sdcard_sync(void) {
+    return sdcard_io_sync(SDCARD_IO_SYNC, 0, 0, NULL);
+}
+
 /**
  * @brief Получить размер загруженного образа в байтах
  */
@@ -346,6 +1082,216 @@ bool sdcard_is_initialized(void) {
     return card_initialized && fs_mounted;
 }
 
+/**
+ * @brief Вывести информацию о карте, счетчики ошибок и время ожидания карты
+ */
+void sdcard_print_card_info(void) {
+    if (!card_initialized) {
+        printf("[SDCARD] Card not initialized\n");
+        return;
+    }
+    
+    static const char *const wait_names[SD_WAIT_KIND_COUNT] = { "command", "read", "write" };
+    const sd_card_info_t *info = sd_card_get_info();
+    
+    printf("[SDCARD] %lu MB, clock %lu kHz\n", info->capacity_mb, info->clock_hz / 1000);
+    printf("[SDCARD] Errors: %lu CRC, %lu read retries, %lu write rejects\n",
+           info->crc_errors, info->read_retries, info->write_errors);
+    
+    for (int i = 0; i < SD_WAIT_KIND_COUNT; i++) {
+        const sd_wait_stats_t *wait = &info->wait[i];
+        printf("[SDCARD] Wait %-7s: %lu waits, avg %lu us, max %lu us\n", wait_names[i], wait->count,
+               wait->count ? (uint32_t)(wait->total_us / wait->count) : 0, wait->max_us);
+    }
+}
+
+// Один проход теста скорости
+typedef struct {
+    const char *name;
+    bool write;
+    bool random;                // Случайные смещения (иначе - подряд по всему файлу)
+    uint32_t op_bytes;          // Размер одной операции
+} sdcard_bench_test_t;
+
+static const sdcard_bench_test_t bench_tests[] = {
+    { "Seq write",    true,  false, SDCARD_BENCH_SEQ_KB * 1024 },
+    { "Seq read",     false, false, SDCARD_BENCH_SEQ_KB * 1024 },
+    { "Rnd read 512", false, true,  FLOPPY_SECTOR_SIZE },
+    { "Rnd write 512", true, true,  FLOPPY_SECTOR_SIZE },
+    { "Rnd read 4K",  false, true,  4096 },
+    { "Rnd write 4K", true,  true,  4096 },
+};
+
+#define BENCH_TEST_COUNT    (sizeof(bench_tests) / sizeof(bench_tests[0]))
+#define BENCH_MAX_OPS       ((SDCARD_BENCH_FILE_KB / SDCARD_BENCH_SEQ_KB > SDCARD_BENCH_RANDOM_OPS) ? \
+                             SDCARD_BENCH_FILE_KB / SDCARD_BENCH_SEQ_KB : SDCARD_BENCH_RANDOM_OPS)
+
+typedef struct {
+    uint32_t mb_x100;           // Скорость, MB/s * 100 (1 MB = 10^6 байт)
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} sdcard_bench_result_t;
+
+static int bench_compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Выполнить один проход теста над открытым файлом
+ * @param samples Время каждой операции (BENCH_MAX_OPS элементов)
+ */
+static bool sdcard_bench_run(FIL *file, const sdcard_bench_test_t *test, uint8_t *buffer,
+                             uint32_t *samples, sdcard_bench_result_t *result) {
+    uint32_t slots = (SDCARD_BENCH_FILE_KB * 1024) / test->op_bytes;
+    uint32_t ops = test->random ? SDCARD_BENCH_RANDOM_OPS : slots;
+    uint32_t seed = 0x2545F491;     // Одинаковая последовательность в каждом запуске
+    
+    uint64_t test_start = time_us_64();
+    
+    for (uint32_t i = 0; i < ops; i++) {
+        uint32_t slot = i;
+        if (test->random) {
+            // xorshift32
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            slot = seed % slots;
+        }
+        
+        uint64_t start = time_us_64();
+        UINT done = 0;
+        FRESULT res = f_lseek(file, (FSIZE_t)slot * test->op_bytes);
+        if (res == FR_OK) {
+            res = test->write ? f_write(file, buffer, test->op_bytes, &done)
+                              : f_read(file, buffer, test->op_bytes, &done);
+        }
+        samples[i] = (uint32_t)(time_us_64() - start);
+        
+        if (res != FR_OK || done != test->op_bytes) {
+            printf("[BENCH] %s failed at offset %lu (error %d)\n", test->name, slot * test->op_bytes, res);
+            return false;
+        }
+    }
+    
+    // Запись засчитывается, только когда данные на карте
+    if (test->write && f_sync(file) != FR_OK) {
+        printf("[BENCH] %s: sync failed\n", test->name);
+        return false;
+    }
+    
+    uint64_t total_us = time_us_64() - test_start;
+    result->mb_x100 = total_us ? (uint32_t)(((uint64_t)ops * test->op_bytes * 100) / total_us) : 0;
+    
+    qsort(samples, ops, sizeof(samples[0]), bench_compare_u32);
+    result->p50_us = samples[ops / 2];
+    result->p99_us = samples[(ops * 99) / 100];
+    result->max_us = samples[ops - 1];
+    
+    return true;
+}
+
+/**
+ * @brief Показать итог теста скорости на OLED
+ */
+static void sdcard_bench_show(const char *line1, const char *line2) {
+    oled_message_t msg;
+    msg.command = OLED_CMD_SHOW_STATUS;
+    strncpy(msg.data.status.status_line1, line1, sizeof(msg.data.status.status_line1) - 1);
+    msg.data.status.status_line1[sizeof(msg.data.status.status_line1) - 1] = '\0';
+    strncpy(msg.data.status.status_line2, line2, sizeof(msg.data.status.status_line2) - 1);
+    msg.data.status.status_line2[sizeof(msg.data.status.status_line2) - 1] = '\0';
+    
+    if (oled_queue != NULL) {
+        xQueueSend(oled_queue, &msg, pdMS_TO_TICKS(100));
+    }
+}
+
+/**
+ * @brief Тест скорости и задержек карты на временном файле
+ * 
+ * Последовательные многоблочные и случайные одно- и многоблочные чтения
+ * и записи через FatFS и драйвер. Результат - в UART и на OLED.
+ * Пока идет тест, задача SDCARD не обслуживает образ, поэтому образ
+ * должен быть извлечен.
+ */
+static void sdcard_benchmark(void) {
+    if (!card_initialized || !fs_mounted) {
+        printf("[BENCH] Card not initialized\n");
+        sdcard_bench_show("SD Benchmark", "No card");
+        return;
+    }
+    if (image_loaded) {
+        printf("[BENCH] Eject the image before running the benchmark\n");
+        sdcard_bench_show("SD Benchmark", "Eject image first");
+        return;
+    }
+    
+    uint8_t *buffer = pvPortMalloc(SDCARD_BENCH_SEQ_KB * 1024);
+    uint32_t *samples = pvPortMalloc(BENCH_MAX_OPS * sizeof(uint32_t));
+    FIL *file = pvPortMalloc(sizeof(FIL));
+    if (buffer == NULL || samples == NULL || file == NULL) {
+        printf("[BENCH] Out of memory\n");
+        sdcard_bench_show("SD Benchmark", "Out of memory");
+        vPortFree(buffer);
+        vPortFree(samples);
+        vPortFree(file);
+        return;
+    }
+    
+    for (uint32_t i = 0; i < SDCARD_BENCH_SEQ_KB * 1024; i++) {
+        buffer[i] = (uint8_t)(i * 7 + 1);
+    }
+    
+    printf("[BENCH] %u KB scratch file %s, %u KB sequential ops, %u random ops\n",
+           SDCARD_BENCH_FILE_KB, SDCARD_BENCH_FILE, SDCARD_BENCH_SEQ_KB, SDCARD_BENCH_RANDOM_OPS);
+    sdcard_bench_show("SD Benchmark", "Running...");
+    
+    sdcard_bench_result_t results[BENCH_TEST_COUNT];
+    bool ok = false;
+    
+    FRESULT res = f_open(file, SDCARD_BENCH_FILE, FA_CREATE_ALWAYS | FA_READ | FA_WRITE);
+    if (res != FR_OK) {
+        printf("[BENCH] Failed to create %s (error %d)\n", SDCARD_BENCH_FILE, res);
+    } else {
+        sd_card_reset_stats();
+        
+        // Первый проход (последовательная запись) создает файл целиком
+        ok = true;
+        for (uint32_t i = 0; i < BENCH_TEST_COUNT && ok; i++) {
+            ok = sdcard_bench_run(file, &bench_tests[i], buffer, samples, &results[i]);
+            if (ok) {
+                printf("[BENCH] %-13s: %lu.%02lu MB/s, p50 %lu us, p99 %lu us, max %lu us\n",
+                       bench_tests[i].name, results[i].mb_x100 / 100, results[i].mb_x100 % 100,
+                       results[i].p50_us, results[i].p99_us, results[i].max_us);
+            }
+        }
+        
+        f_close(file);
+        f_unlink(SDCARD_BENCH_FILE);
+        sdcard_print_card_info();
+    }
+    
+    if (ok) {
+        // Последовательное чтение/запись и p99 случайных одноблочных операций
+        char line1[32];
+        char line2[32];
+        snprintf(line1, sizeof(line1), "R %lu.%02lu W %lu.%02lu MB/s",
+                 results[1].mb_x100 / 100, results[1].mb_x100 % 100,
+                 results[0].mb_x100 / 100, results[0].mb_x100 % 100);
+        snprintf(line2, sizeof(line2), "p99 R%lu W%lu us", results[2].p99_us, results[3].p99_us);
+        sdcard_bench_show(line1, line2);
+    } else {
+        sdcard_bench_show("SD Benchmark", "Failed");
+    }
+    
+    vPortFree(buffer);
+    vPortFree(samples);
+    vPortFree(file);
+}
+
 /**
  * @brief Основная задача SD карты
  */
@@ -355,20 +1301,27 @@ void sdcard_task(void *pvParameters) {
     printf("[SDCARD] Task started\n");
     
     TickType_t last_check_time = xTaskGetTickCount();
-    const TickType_t check_interval = pdMS_TO_TICKS(500);  // Проверка каждые 500 мс
+    TickType_t last_io_time = last_check_time;
+    const TickType_t check_interval = pdMS_TO_TICKS(SD_PRESENCE_POLL_MS);
     
     while (1) {
-        // Проверка наличия карты, если она не инициализирована
-        if (!card_initialized) {
-            TickType_t current_time = xTaskGetTickCount();
-            
-            if (current_time - last_check_time >= check_interval) {
+        TickType_t current_time = xTaskGetTickCount();
+        
+        if (current_time - last_check_time >= check_interval) {
+            if (!card_initialized) {
+                last_check_time = current_time;
+                
+                // Попытка инициализации (список каталога меню запрашивает само)
+                if (sdcard_card_present()) {
+                    sdcard_init_card();
+                }
+            } else if (current_time - last_io_time >= check_interval) {
+                // Проверка извлечения только при простое: CMD13 закрывает
+                // открытые многоблочные операции драйвера
                 last_check_time = current_time;
                 
-                // Попытка инициализации
-                if (sdcard_init_card()) {
-                    // Автоматически получить список файлов после успешной инициализации
-                    sdcard_list_images("/");  // Корневой каталог по умолчанию
+                if (!sdcard_card_present()) {
+                    sdcard_card_removed();
                 }
             }
         }
@@ -379,19 +1332,36 @@ void sdcard_task(void *pvParameters) {
             switch (msg.command) {
                 case SDCARD_CMD_LIST_IMAGES:
                     // Использовать путь из сообщения или корневой каталог
-                    if (msg.data.path[0] != '\0') {
-                        sdcard_list_images(msg.data.path);
-                    } else {
-                        sdcard_list_images("/");
-                    }
+                    sdcard_list_images(msg.data.list.path[0] != '\0' ? msg.data.list.path : "/",
+                                       msg.data.list.offset, msg.data.list.count,
+                                       msg.data.list.page);
                     break;
                     
                 case SDCARD_CMD_LOAD_IMAGE:
                     sdcard_load_image(msg.data.filename);
                     break;
                     
+                case SDCARD_CMD_IO:
+                    if (sdcard_process_io(msg.data.io)) {
+                        last_io_time = xTaskGetTickCount();
+                    } else if (card_initialized && !sdcard_card_present()) {
+                        // Ошибка обмена - проверить карту сразу, не дожидаясь простоя:
+                        // без вывода CD повторные ошибки иначе откладывали бы проверку
+                        sdcard_card_removed();
+                    }
+                    break;
+                    
+                case SDCARD_CMD_BENCHMARK:
+                    sdcard_benchmark();
+                    break;
+                    
+                case SDCARD_CMD_CREATE_IMAGE:
+                    sdcard_create_image(msg.data.create.filename, msg.data.create.format);
+                    break;
+                    
                 case SDCARD_CMD_EJECT:
                     if (file_opened) {
+                        sd_card_sync();
                         f_close(&current_file);
                         file_opened = false;
                     }
@@ -423,6 +1393,17 @@ void sdcard_task_init(void) {
         return;
     }
     
+#if SD_PIN_CD >= 0
+    // Вывод Card Detect: контакт слота замыкается на GND или на питание
+    gpio_init(SD_PIN_CD);
+    gpio_set_dir(SD_PIN_CD, GPIO_IN);
+    if (SD_CD_ACTIVE_LOW) {
+        gpio_pull_up(SD_PIN_CD);
+    } else {
+        gpio_pull_down(SD_PIN_CD);
+    }
+#endif
+    
     // Создание задачи
     BaseType_t result = xTaskCreate(
         sdcard_task,
@@ -430,7 +1411,7 @@ void sdcard_task_init(void) {
         STACK_SIZE_STORAGE,
         NULL,
         TASK_PRIORITY_STORAGE,
-        NULL
+        &sdcard_task_handle
     );
     
     if (result != pdPASS) {
@@ -4,6 +4,8 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
+#include "config.h"           // IMAGE_PATH_MAX
+#include "floppy_emu_task.h"  // floppy_type_t для SDCARD_CMD_CREATE_IMAGE
 #include <stdbool.h>
 
 // Команды для SD карты
@@ -11,36 +13,104 @@ typedef enum {
     SDCARD_CMD_INIT,            // Инициализация карты
     SDCARD_CMD_LIST_IMAGES,     // Получить список образов
     SDCARD_CMD_LOAD_IMAGE,      // Загрузить образ
-    SDCARD_CMD_READ_SECTOR,     // Прочитать сектор
-    SDCARD_CMD_WRITE_SECTOR,    // Записать сектор
+    SDCARD_CMD_IO,              // Запрос ввода-вывода образа (sdcard_io_request_t)
+    SDCARD_CMD_BENCHMARK,       // Тест скорости карты (при извлеченном образе)
+    SDCARD_CMD_CREATE_IMAGE,    // Создать чистый непрерывный образ FAT12
     SDCARD_CMD_EJECT            // Извлечь диск
 } sdcard_cmd_t;
 
+// Операции с образом, выполняемые задачей SDCARD
+typedef enum {
+    SDCARD_IO_READ,             // Чтение секторов
+    SDCARD_IO_WRITE,            // Запись секторов (без синхронизации)
+    SDCARD_IO_SYNC              // f_sync: записанное попадает на карту
+} sdcard_io_op_t;
+
+typedef enum {
+    SDCARD_IO_PENDING,          // В очереди или выполняется
+    SDCARD_IO_DONE,             // Выполнен успешно
+    SDCARD_IO_FAILED            // Ошибка
+} sdcard_io_state_t;
+
+typedef struct sdcard_io_request sdcard_io_request_t;
+
+// Callback завершения (вызывается в задаче SDCARD, не должен блокироваться)
+typedef void (*sdcard_io_callback_t)(sdcard_io_request_t *req);
+
+// Запрос ввода-вывода: память принадлежит отправителю до завершения
+struct sdcard_io_request {
+    sdcard_io_op_t op;
+    uint32_t sector;                // Первый сектор образа
+    uint32_t count;                 // Количество секторов
+    uint8_t *buffer;                // READ - куда, WRITE - откуда
+    sdcard_io_callback_t callback;  // Может быть NULL
+    TaskHandle_t notify_task;       // Уведомляется по SDCARD_IO_NOTIFY_INDEX (может быть NULL)
+    void *context;                  // Для callback
+    volatile sdcard_io_state_t state;
+};
+
+// Слот уведомлений задачи для завершения запросов (слот 1 занят DMA драйвера SD)
+#define SDCARD_IO_NOTIFY_INDEX  2
+
+// Соседние запросы, объединяемые в одну операцию с картой
+#define SDCARD_IO_MERGE_MAX     8
+
+// Серий кластеров образа в таблице прямого доступа (сектор образа -> LBA)
+#define SDCARD_MAX_EXTENTS      32
+
+// Таблица fast seek FatFS: по 2 элемента на фрагмент + размер и терминатор
+#define SDCARD_CLMT_SIZE        (2 * SDCARD_MAX_EXTENTS + 2)
+
+// Постраничный список каталога: имя записи (длиннее - короткое имя 8.3)
+// и записей в одной странице
+#define SDCARD_NAME_MAX         96
+#define SDCARD_LIST_PAGE_MAX    8
+
+// Запись каталога в списке образов
+typedef struct {
+    char name[SDCARD_NAME_MAX];     // Имя для пути (длинное или 8.3)
+    bool is_dir;
+    uint32_t size;                  // Размер файла в байтах
+} sdcard_dir_entry_t;
+
+// Страница списка: память принадлежит запросившему до ответа
+typedef struct {
+    uint16_t offset;                // Номер первой записи среди показываемых
+    uint8_t count;                  // Записей в странице
+    bool end;                       // На этой странице каталог закончился
+    sdcard_dir_entry_t entries[SDCARD_LIST_PAGE_MAX];
+} sdcard_dir_page_t;
+
+// Тест скорости: временный файл, размер операций последовательного доступа,
+// число операций случайного доступа
+#define SDCARD_BENCH_FILE       "/bench.tmp"
+#define SDCARD_BENCH_FILE_KB    1024
+#define SDCARD_BENCH_SEQ_KB     16
+#define SDCARD_BENCH_RANDOM_OPS 200
+
 // Структура сообщения для SD карты
 typedef struct {
     sdcard_cmd_t command;
     union {
-        char filename[64];
-        char path[128];  // Путь для SDCARD_CMD_LIST_IMAGES
+        char filename[IMAGE_PATH_MAX];  // Для SDCARD_CMD_LOAD_IMAGE
         struct {
-            uint32_t sector;
-            uint8_t *buffer;
-        } sector_io;
+            char path[IMAGE_PATH_MAX];  // Каталог ("" - корневой)
+            uint16_t offset;            // Первая запись страницы
+            uint8_t count;              // Не больше SDCARD_LIST_PAGE_MAX
+            sdcard_dir_page_t *page;    // Заполняется задачей SDCARD
+        } list;                         // Для SDCARD_CMD_LIST_IMAGES
+        sdcard_io_request_t *io;    // Для SDCARD_CMD_IO
+        struct {
+            char filename[IMAGE_PATH_MAX];  // Имя в корневом каталоге с расширением
+            floppy_type_t format;
+        } create;                   // Для SDCARD_CMD_CREATE_IMAGE
     } data;
 } sdcard_message_t;
 
-// Структура ответа от SD карты
+// Структура ответа от SD карты: данные передаются по ссылке из запроса
 typedef struct {
     bool success;
-    union {
-        struct {
-            char files[32][32];  // До 32 файлов
-            uint8_t count;
-        } file_list;
-        struct {
-            uint8_t data[512];
-        } sector_data;
-    } data;
+    sdcard_dir_page_t *page;        // Страница из SDCARD_CMD_LIST_IMAGES
 } sdcard_response_t;
 
 // Глобальная очередь для SD карты
@@ -58,7 +128,12 @@ void sdcard_task(void *pvParameters);
 // API функции
 bool sdcard_is_initialized(void);
 bool sdcard_read_sector(uint32_t sector, uint8_t *buffer);
+bool sdcard_read_sectors(uint32_t sector, uint32_t count, uint8_t *buffer);
 bool sdcard_write_sector(uint32_t sector, const uint8_t *buffer);
+bool sdcard_write_sectors(uint32_t sector, uint32_t count, const uint8_t *buffer);
+bool sdcard_sync(void);
+bool sdcard_submit_io(sdcard_io_request_t *req);
+void sdcard_print_card_info(void);
 uint32_t sdcard_get_image_size(void);
 
 #endif // SDCARD_TASK_H
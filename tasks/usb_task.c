@@ -6,6 +6,9 @@
 #include <stdio.h>
 #include <string.h>
 
+// SYNCHRONIZE CACHE (10): TinyUSB передает ее в tud_msc_scsi_cb()
+#define SCSI_CMD_SYNC_CACHE_10  0x35
+
 // Очередь для команд
 QueueHandle_t usb_queue = NULL;
 
@@ -130,25 +133,35 @@ void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16
  */
 int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize) {
     (void)lun;
-    (void)offset;  // offset всегда 0, так как читаем по одному сектору
+    (void)offset;  // offset всегда 0: буфер кратен размеру сектора
     
     // Получить информацию о загруженном образе для проверки границ
     const floppy_info_t* info = floppy_get_info();
     uint32_t max_sectors = (info != NULL && info->total_sectors > 0) ? info->total_sectors : FLOPPY_SECTORS;
     
-    // Проверка границ
-    if (lba >= max_sectors) {
-        printf("[USB] Read error: LBA %lu out of range (max: %lu)\n", lba, max_sectors);
+    // Проверка границ (TinyUSB передает до CFG_TUD_MSC_EP_BUFSIZE байт за вызов)
+    uint32_t count = bufsize / FLOPPY_SECTOR_SIZE;
+    if (lba + count > max_sectors) {
+        printf("[USB] Read error: LBA %lu+%lu out of range (max: %lu)\n", lba, count, max_sectors);
         return -1;
     }
     
-    // Чтение через эмулятор (с кешем)
-    if (!floppy_read_sector(lba, (uint8_t*)buffer)) {
-        printf("[USB] Read error at LBA %lu\n", lba);
-        return -1;
+    // Попадания копируются в буфер TinyUSB под mutex кеша, по одному захвату на блок.
+    // При промахе чтение выполняет задача SDCARD: возврат 0 - TinyUSB повторит
+    // вызов, а USB тем временем продолжает обслуживать хост
+    switch (floppy_try_read_sectors(lba, count, (uint8_t*)buffer)) {
+        case FLOPPY_READ_OK:
+            return bufsize;
+            
+        case FLOPPY_READ_BUSY:
+            // Короткое ожидание отдает процессор задаче SDCARD (она ниже по приоритету)
+            floppy_wait_read(1);
+            return 0;
+            
+        default:
+            printf("[USB] Read error at LBA %lu\n", lba);
+            return -1;
     }
-    
-    return bufsize;
 }
 
 /**
@@ -163,13 +176,14 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t*
     uint32_t max_sectors = (info != NULL && info->total_sectors > 0) ? info->total_sectors : FLOPPY_SECTORS;
     
     // Проверка границ
-    if (lba >= max_sectors) {
-        printf("[USB] Write error: LBA %lu out of range (max: %lu)\n", lba, max_sectors);
+    uint32_t count = bufsize / FLOPPY_SECTOR_SIZE;
+    if (lba + count > max_sectors) {
+        printf("[USB] Write error: LBA %lu+%lu out of range (max: %lu)\n", lba, count, max_sectors);
         return -1;
     }
     
-    // Запись через эмулятор (с кешем)
-    if (!floppy_write_sector(lba, buffer)) {
+    // Запись через эмулятор (с кешем), до 8 секторов за вызов
+    if (!floppy_write_sectors(lba, count, buffer)) {
         printf("[USB] Write error at LBA %lu\n", lba);
         return -1;
     }
@@ -182,7 +196,8 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t*
  */
 void tud_msc_write10_complete_cb(uint8_t lun) {
     (void)lun;
-    // Здесь можно принудительно сбросить кеш, но у нас он и так умный
+    // Запустить запись данных на карту; барьер - по SYNCHRONIZE CACHE или простою
+    floppy_write_complete();
 }
 
 /**
@@ -196,6 +211,14 @@ int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void* buffer, u
     // Здесь можно добавить кастомные команды
     
     switch (scsi_cmd[0]) {
+        case SCSI_CMD_SYNC_CACHE_10:
+            // Барьер записи: все принятые данные на карте
+            if (!floppy_flush()) {
+                tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);  // WRITE ERROR
+                resplen = -1;
+            }
+            break;
+            
         default:
             // Неизвестная команда - установить ошибку
             tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
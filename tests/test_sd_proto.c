@@ -0,0 +1,453 @@
+/**
+ * @file test_sd_proto.c
+ * @brief Host tests of drivers/sd_proto.c against a software SD card model
+ *
+ * The model frames commands, responses and 4-bit data the way a card does
+ * on the bus, bit by bit, with its own bitwise CRCs. The protocol helpers
+ * must agree with it on every frame.
+ */
+
+#include "sd_proto.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+        unsigned long long a_ = (unsigned long long)(actual); \
+        unsigned long long e_ = (unsigned long long)(expected); \
+        if (a_ != e_) { \
+            printf("%s:%d: %s = 0x%llX, expected 0x%llX\n", __FILE__, __LINE__, #actual, a_, e_); \
+            failures++; \
+        } \
+    } while (0)
+
+// ---------------------------------------------------------------------------
+// Software card model
+// ---------------------------------------------------------------------------
+
+// Bit stream on one bus line, first transmitted bit first
+typedef struct {
+    uint8_t bits[SD_DATA4_NIBBLES * 4];
+    uint32_t count;
+} bitstream_t;
+
+static void bits_push(bitstream_t *s, uint32_t value, uint32_t width) {
+    for (uint32_t i = 0; i < width; i++) {
+        s->bits[s->count++] = (value >> (width - 1 - i)) & 1;
+    }
+}
+
+/**
+ * @brief Reference CRC: polynomial long division of a bit string, MSB first
+ */
+static uint32_t model_crc(const uint8_t *bits, uint32_t count, uint32_t poly, uint32_t width) {
+    uint32_t top = 1u << (width - 1);
+    uint32_t mask = (top << 1) - 1;
+    uint32_t crc = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        bool feedback = ((crc & top) != 0) != (bits[i] != 0);
+        crc = (crc << 1) & mask;
+        if (feedback) {
+            crc ^= poly;
+        }
+    }
+    return crc;
+}
+
+static uint32_t model_crc7(const uint8_t *bits, uint32_t count) {
+    return model_crc(bits, count, 0x09, 7);
+}
+
+static uint32_t model_crc16(const uint8_t *bits, uint32_t count) {
+    return model_crc(bits, count, 0x1021, 16);
+}
+
+/**
+ * @brief Short response as sent by the card: 0, 0, index, payload, CRC7, 1
+ * @note R3 carries all ones in place of the index and the CRC
+ */
+static void model_short_response(bitstream_t *s, uint8_t index, uint32_t payload, bool r3) {
+    s->count = 0;
+    bits_push(s, 0, 2);
+    bits_push(s, r3 ? 0x3F : index, 6);
+    bits_push(s, payload, 32);
+    bits_push(s, r3 ? 0x7F : model_crc7(s->bits, s->count), 7);
+    bits_push(s, 1, 1);
+}
+
+/**
+ * @brief R2 response: 0, 0, 111111, register bits 127..1 (CRC7 in 7..1), 1
+ * @param reg Register; its last byte is replaced with CRC7 and end bit
+ */
+static void model_long_response(bitstream_t *s, uint8_t reg[16]) {
+    s->count = 0;
+    bits_push(s, 0, 2);
+    bits_push(s, 0x3F, 6);
+
+    uint32_t reg_start = s->count;
+    for (int i = 0; i < 15; i++) {
+        bits_push(s, reg[i], 8);
+    }
+    uint32_t crc = model_crc7(&s->bits[reg_start], s->count - reg_start);
+    reg[15] = (uint8_t)((crc << 1) | 1);
+    bits_push(s, crc, 7);
+    bits_push(s, 1, 1);
+}
+
+/**
+ * @brief Words as captured by the PIO: full words MSB first, tail right-aligned
+ */
+static void model_capture(const bitstream_t *s, uint32_t *words) {
+    for (uint32_t w = 0; w < (s->count + 31) / 32; w++) {
+        words[w] = 0;
+    }
+    for (uint32_t n = 0; n < s->count; n++) {
+        words[n / 32] = (words[n / 32] << 1) | s->bits[n];
+    }
+}
+
+/**
+ * @brief Receive a response the way the drivers do: capture, unpack, parse
+ */
+static sd_proto_result_t model_receive(const bitstream_t *s, sd_resp_type_t type, uint8_t cmd,
+                                       uint8_t *resp, uint32_t *value) {
+    uint32_t words[(SD_RESP_LONG_BITS + 31) / 32];
+
+    CHECK_EQ(s->count, sd_proto_response_bits(type));
+    model_capture(s, words);
+    sd_proto_unpack_bits(words, s->count, resp);
+    return sd_proto_parse_response(type, cmd, resp, value);
+}
+
+/**
+ * @brief Put a bit of a CSD field; bit 127 is the MSB of csd[0]
+ */
+static void csd_set(uint8_t csd[16], uint32_t msb, uint32_t width, uint32_t value) {
+    for (uint32_t i = 0; i < width; i++) {
+        uint32_t bit = msb - i;
+        uint8_t *byte = &csd[(127 - bit) / 8];
+        uint8_t mask = (uint8_t)(1u << (bit % 8));
+        if ((value >> (width - 1 - i)) & 1) {
+            *byte |= mask;
+        } else {
+            *byte &= (uint8_t)~mask;
+        }
+    }
+}
+
+/**
+ * @brief Send a block on DAT0-3 and return the CRC nibbles that follow it
+ *
+ * Each line carries bit k of every nibble and gets its own CRC16; the
+ * 16 CRC bits of all lines then go out as 16 nibbles.
+ */
+static void model_block_crc(const uint8_t *data, size_t length, uint8_t crc_out[SD_DATA4_CRC_BYTES]) {
+    static bitstream_t lines[4];
+    uint16_t crc[4];
+
+    for (int k = 0; k < 4; k++) {
+        lines[k].count = 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        uint8_t nibbles[2] = { (uint8_t)(data[i] >> 4), (uint8_t)(data[i] & 0x0F) };
+        for (int n = 0; n < 2; n++) {
+            for (int k = 0; k < 4; k++) {
+                bits_push(&lines[k], (nibbles[n] >> k) & 1, 1);
+            }
+        }
+    }
+    for (int k = 0; k < 4; k++) {
+        crc[k] = (uint16_t)model_crc16(lines[k].bits, lines[k].count);
+    }
+
+    memset(crc_out, 0, SD_DATA4_CRC_BYTES);
+    for (int bit = 0; bit < 16; bit++) {
+        uint8_t nibble = 0;
+        for (int k = 0; k < 4; k++) {
+            nibble |= (uint8_t)(((crc[k] >> (15 - bit)) & 1) << k);
+        }
+        crc_out[bit / 2] |= (bit % 2 == 0) ? (uint8_t)(nibble << 4) : nibble;
+    }
+}
+
+// Deterministic test data
+static void fill_pattern(uint8_t *data, size_t length, uint32_t seed) {
+    for (size_t i = 0; i < length; i++) {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Tests
+// ---------------------------------------------------------------------------
+
+static void test_crc7(void) {
+    // Known command CRCs from the SD specification examples
+    static const uint8_t cmd0[5]  = { 0x40, 0x00, 0x00, 0x00, 0x00 };
+    static const uint8_t cmd17[5] = { 0x51, 0x00, 0x00, 0x00, 0x00 };
+    static const uint8_t r1[5]    = { 0x11, 0x00, 0x00, 0x09, 0x00 };
+    CHECK_EQ(sd_proto_crc7(cmd0, 5), 0x4A);
+    CHECK_EQ(sd_proto_crc7(cmd17, 5), 0x2A);
+    CHECK_EQ(sd_proto_crc7(r1, 5), 0x33);
+
+    uint8_t data[16];
+    bitstream_t s;
+    for (uint32_t seed = 1; seed < 64; seed++) {
+        size_t length = 1 + seed % sizeof(data);
+        fill_pattern(data, length, seed);
+        s.count = 0;
+        for (size_t i = 0; i < length; i++) {
+            bits_push(&s, data[i], 8);
+        }
+        CHECK_EQ(sd_proto_crc7(data, length), model_crc7(s.bits, s.count));
+    }
+}
+
+static void test_crc16(void) {
+    uint8_t block[SD_BLOCK_SIZE];
+
+    // Specification example: 512 bytes of 0xFF
+    memset(block, 0xFF, sizeof(block));
+    CHECK_EQ(sd_proto_crc16(block, sizeof(block)), 0x7FA1);
+
+    static bitstream_t s;
+    for (uint32_t seed = 1; seed < 8; seed++) {
+        fill_pattern(block, sizeof(block), seed);
+        s.count = 0;
+        for (size_t i = 0; i < sizeof(block); i++) {
+            bits_push(&s, block[i], 8);
+        }
+        CHECK_EQ(sd_proto_crc16(block, sizeof(block)), model_crc16(s.bits, s.count));
+    }
+}
+
+static void test_crc16_4bit(void) {
+    uint8_t block[SD_BLOCK_SIZE];
+    uint8_t expected[SD_DATA4_CRC_BYTES];
+    uint8_t actual[SD_DATA4_CRC_BYTES];
+
+    for (uint32_t seed = 0; seed < 8; seed++) {
+        if (seed == 0) {
+            memset(block, 0xFF, sizeof(block));
+        } else {
+            fill_pattern(block, sizeof(block), seed);
+        }
+
+        model_block_crc(block, sizeof(block), expected);
+        sd_proto_put_crc16_4bit(sd_proto_crc16_4bit(block, sizeof(block)), actual);
+        CHECK(memcmp(actual, expected, sizeof(expected)) == 0);
+        CHECK(sd_proto_check_crc16_4bit(block, sizeof(block), expected));
+
+        // A single flipped bit on any line must be caught
+        block[seed * 61 % sizeof(block)] ^= (uint8_t)(1u << (seed % 8));
+        CHECK(!sd_proto_check_crc16_4bit(block, sizeof(block), expected));
+    }
+
+    // Short transfers (64-byte status blocks) use the same framing
+    fill_pattern(block, 64, 99);
+    model_block_crc(block, 64, expected);
+    CHECK(sd_proto_check_crc16_4bit(block, 64, expected));
+}
+
+static void test_pack_command(void) {
+    static const struct {
+        uint8_t cmd;
+        uint32_t arg;
+        uint8_t packet[SD_CMD_PACKET_BYTES];
+    } known[] = {
+        { 0,  0x00000000, { 0x40, 0x00, 0x00, 0x00, 0x00, 0x95 } },
+        { 8,  0x000001AA, { 0x48, 0x00, 0x00, 0x01, 0xAA, 0x87 } },
+        { 17, 0x00000000, { 0x51, 0x00, 0x00, 0x00, 0x00, 0x55 } },
+    };
+    uint8_t packet[SD_CMD_PACKET_BYTES];
+
+    for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+        sd_proto_pack_command(known[i].cmd, known[i].arg, packet);
+        CHECK(memcmp(packet, known[i].packet, sizeof(packet)) == 0);
+    }
+
+    // The card accepts a command only with start bits 01, its CRC7 and end bit 1
+    bitstream_t s;
+    for (uint8_t cmd = 0; cmd < 64; cmd++) {
+        uint32_t arg = 0x9E3779B9u * (cmd + 1);
+        sd_proto_pack_command(cmd, arg, packet);
+
+        s.count = 0;
+        for (int i = 0; i < SD_CMD_PACKET_BYTES; i++) {
+            bits_push(&s, packet[i], 8);
+        }
+        CHECK_EQ(s.bits[0], 0);
+        CHECK_EQ(s.bits[1], 1);
+        CHECK_EQ(packet[0] & 0x3F, cmd);
+        CHECK_EQ(((uint32_t)packet[1] << 24) | ((uint32_t)packet[2] << 16) |
+                 ((uint32_t)packet[3] << 8) | packet[4], arg);
+        CHECK_EQ(packet[5] >> 1, model_crc7(s.bits, 40));
+        CHECK_EQ(s.bits[47], 1);
+    }
+}
+
+static void test_response_bits(void) {
+    CHECK_EQ(sd_proto_response_bits(SD_RESP_NONE), 0);
+    CHECK_EQ(sd_proto_response_bits(SD_RESP_R1), SD_RESP_SHORT_BITS);
+    CHECK_EQ(sd_proto_response_bits(SD_RESP_R1B), SD_RESP_SHORT_BITS);
+    CHECK_EQ(sd_proto_response_bits(SD_RESP_R2), SD_RESP_LONG_BITS);
+    CHECK_EQ(sd_proto_response_bits(SD_RESP_R3), SD_RESP_SHORT_BITS);
+    CHECK_EQ(sd_proto_response_bits(SD_RESP_R6), SD_RESP_SHORT_BITS);
+    CHECK_EQ(sd_proto_response_bits(SD_RESP_R7), SD_RESP_SHORT_BITS);
+}
+
+static void test_short_responses(void) {
+    bitstream_t s;
+    uint8_t resp[17];
+    uint32_t value;
+
+    // R1: transfer state, ready for data
+    model_short_response(&s, 13, 0x00000900, false);
+    value = 0;
+    CHECK_EQ(model_receive(&s, SD_RESP_R1, 13, resp, &value), SD_PROTO_OK);
+    CHECK_EQ(value, 0x00000900);
+    CHECK_EQ(SD_STATUS_STATE(value), 4);
+
+    // R1 with OUT_OF_RANGE: the status is still returned
+    model_short_response(&s, 18, 0x80000900, false);
+    CHECK_EQ(model_receive(&s, SD_RESP_R1, 18, resp, &value), SD_PROTO_ERR_STATUS);
+    CHECK_EQ(value, 0x80000900);
+
+    // R1b is framed like R1
+    model_short_response(&s, 12, 0x00000E00, false);
+    CHECK_EQ(model_receive(&s, SD_RESP_R1B, 12, resp, &value), SD_PROTO_OK);
+
+    // R3: OCR without index and CRC
+    model_short_response(&s, 41, SD_OCR_BUSY | SD_OCR_CCS | SD_OCR_VOLTAGE_3V3, true);
+    CHECK_EQ(model_receive(&s, SD_RESP_R3, 41, resp, &value), SD_PROTO_OK);
+    CHECK_EQ(value, SD_OCR_BUSY | SD_OCR_CCS | SD_OCR_VOLTAGE_3V3);
+
+    // R6: published RCA, then the error bits of the short status
+    model_short_response(&s, 3, 0xB3680500, false);
+    CHECK_EQ(model_receive(&s, SD_RESP_R6, 3, resp, &value), SD_PROTO_OK);
+    CHECK_EQ(value >> 16, 0xB368);
+    model_short_response(&s, 3, 0xB3682500, false);
+    CHECK_EQ(model_receive(&s, SD_RESP_R6, 3, resp, &value), SD_PROTO_ERR_STATUS);
+
+    // R7: interface condition echo
+    model_short_response(&s, 8, 0x000001AA, false);
+    CHECK_EQ(model_receive(&s, SD_RESP_R7, 8, resp, &value), SD_PROTO_OK);
+    CHECK_EQ(value, 0x000001AA);
+
+    // Response to a different command
+    model_short_response(&s, 17, 0x00000900, false);
+    CHECK_EQ(model_receive(&s, SD_RESP_R1, 13, resp, &value), SD_PROTO_ERR_INDEX);
+
+    // Any flipped bit between the start bits and the CRC
+    for (uint32_t bit = 8; bit < 47; bit++) {
+        model_short_response(&s, 13, 0x00000900, false);
+        s.bits[bit] ^= 1;
+        CHECK_EQ(model_receive(&s, SD_RESP_R1, 13, resp, &value), SD_PROTO_ERR_CRC);
+    }
+
+    // Start, transmission and end bits
+    model_short_response(&s, 13, 0x00000900, false);
+    s.bits[0] = 1;
+    CHECK_EQ(model_receive(&s, SD_RESP_R1, 13, resp, &value), SD_PROTO_ERR_FRAME);
+    model_short_response(&s, 13, 0x00000900, false);
+    s.bits[1] = 1;
+    CHECK_EQ(model_receive(&s, SD_RESP_R1, 13, resp, &value), SD_PROTO_ERR_FRAME);
+    model_short_response(&s, 13, 0x00000900, false);
+    s.bits[47] = 0;
+    CHECK_EQ(model_receive(&s, SD_RESP_R1, 13, resp, &value), SD_PROTO_ERR_FRAME);
+}
+
+static void test_csd(void) {
+    bitstream_t s;
+    uint8_t csd[16];
+    uint8_t resp[17];
+
+    // CSD v1, 2 GB: (4095 + 1) * 2^(7 + 2) blocks of 2^10 bytes
+    memset(csd, 0, sizeof(csd));
+    csd_set(csd, 127, 2, 0);
+    csd_set(csd, 103, 8, 0x32);
+    csd_set(csd, 83, 4, 10);
+    csd_set(csd, 73, 12, 4095);
+    csd_set(csd, 49, 3, 7);
+    model_long_response(&s, csd);
+    CHECK_EQ(model_receive(&s, SD_RESP_R2, 9, resp, NULL), SD_PROTO_OK);
+    CHECK(memcmp(&resp[1], csd, sizeof(csd)) == 0);
+    CHECK_EQ(sd_proto_csd_sectors(&resp[1]), 4194304);
+    CHECK_EQ(sd_proto_csd_tran_speed_hz(&resp[1]), 25000000);
+
+    // CSD v1, 120 MB: (3839 + 1) * 2^(5 + 2) blocks of 2^9 bytes
+    memset(csd, 0, sizeof(csd));
+    csd_set(csd, 83, 4, 9);
+    csd_set(csd, 73, 12, 3839);
+    csd_set(csd, 49, 3, 5);
+    CHECK_EQ(sd_proto_csd_sectors(csd), 491520);
+
+    // CSD v2 (SDHC): (C_SIZE + 1) * 512 KB
+    memset(csd, 0, sizeof(csd));
+    csd_set(csd, 127, 2, 1);
+    csd_set(csd, 103, 8, 0x5A);
+    csd_set(csd, 83, 4, 9);
+    csd_set(csd, 69, 22, 15159);
+    model_long_response(&s, csd);
+    CHECK_EQ(model_receive(&s, SD_RESP_R2, 9, resp, NULL), SD_PROTO_OK);
+    CHECK_EQ(sd_proto_csd_sectors(&resp[1]), 15523840);
+    CHECK_EQ(sd_proto_csd_tran_speed_hz(&resp[1]), 50000000);
+
+    // Largest SDXC C_SIZE uses all 22 bits
+    csd_set(csd, 69, 22, 0x3FFFFF - 1);
+    CHECK_EQ(sd_proto_csd_sectors(csd), 0x3FFFFFu * 1024u);
+
+    // Corrupted register
+    model_long_response(&s, csd);
+    s.bits[60] ^= 1;
+    CHECK_EQ(model_receive(&s, SD_RESP_R2, 9, resp, NULL), SD_PROTO_ERR_CRC);
+    model_long_response(&s, csd);
+    s.bits[135] = 0;
+    CHECK_EQ(model_receive(&s, SD_RESP_R2, 9, resp, NULL), SD_PROTO_ERR_FRAME);
+}
+
+static void test_tran_speed(void) {
+    uint8_t csd[16] = { 0 };
+
+    csd[3] = 0x32;  // 2.5 x 10 Mbit/s
+    CHECK_EQ(sd_proto_csd_tran_speed_hz(csd), 25000000);
+    csd[3] = 0x5A;  // 5.0 x 10 Mbit/s
+    CHECK_EQ(sd_proto_csd_tran_speed_hz(csd), 50000000);
+    csd[3] = 0x0A;  // 1.0 x 10 Mbit/s
+    CHECK_EQ(sd_proto_csd_tran_speed_hz(csd), 10000000);
+    csd[3] = 0x29;  // 2.0 x 1 Mbit/s
+    CHECK_EQ(sd_proto_csd_tran_speed_hz(csd), 2000000);
+    csd[3] = 0x0B;  // 1.0 x 100 Mbit/s
+    CHECK_EQ(sd_proto_csd_tran_speed_hz(csd), 100000000);
+    csd[3] = 0x37;  // Reserved unit
+    CHECK_EQ(sd_proto_csd_tran_speed_hz(csd), 0);
+}
+
+int main(void) {
+    test_crc7();
+    test_crc16();
+    test_crc16_4bit();
+    test_pack_command();
+    test_response_bits();
+    test_short_responses();
+    test_csd();
+    test_tran_speed();
+
+    if (failures != 0) {
+        printf("sd_proto: %d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("sd_proto: all checks passed\n");
+    return 0;
+}
@@ -91,7 +91,8 @@ extern "C" {
 #define CFG_TUD_VENDOR            0
 
 // MSC Buffer size of Device Mass storage
-#define CFG_TUD_MSC_EP_BUFSIZE    512
+// 4KB = блок кеша: READ10/WRITE10 передаются в callback по 8 секторов
+#define CFG_TUD_MSC_EP_BUFSIZE    4096
 
 #ifdef __cplusplus
 }